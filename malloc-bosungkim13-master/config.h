@@ -58,9 +58,67 @@
 #define ALIGNMENT 8
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes.  The shared library that replaces malloc
+ * overrides it, since real programs need more room than the traces.
  */
+#ifndef MAX_HEAP
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#endif
+
+/*
+ * Set MM_THREADS to "1" to make the allocator and the memory system model
+ * thread safe.  Each thread then caches recently freed blocks, so most
+ * malloc/free pairs never take the shared heap lock.
+ */
+#ifndef MM_THREADS
+#define MM_THREADS 1
+#endif
+
+/*
+ * With MM_THREADS, the heap is split into an arena per NUMA node, up to
+ * MM_ARENAS of them.  Threads allocate from the arena of the node they
+ * run on, and each block is freed back to the arena it came from.
+ */
+#ifndef MM_ARENAS
+#define MM_ARENAS 8
+#endif
+
+/*
+ * Set MM_QUICKLISTS to "1" to defer coalescing.  Freed blocks of up to
+ * 1 KiB then wait on exact-size lists for reuse and are only coalesced in
+ * bulk, when a search of the free lists fails or too many are waiting.
+ */
+#ifndef MM_QUICKLISTS
+#define MM_QUICKLISTS 1
+#endif
+
+/*
+ * Set MM_STATS to "1" to make the allocator count what it does for
+ * mm_get_stats().  With "0", the counters and every update of them are
+ * compiled out.
+ */
+#ifndef MM_STATS
+#define MM_STATS 0
+#endif
+
+/*
+ * Set MM_PROFILE to "1" to build the sampling heap profiler.  It costs a
+ * subtraction per allocation and a table lookup per free while it's off.
+ */
+#ifndef MM_PROFILE
+#define MM_PROFILE 0
+#endif
+
+/*
+ * Set MM_HUGEPAGES to "1" to lay the heap out for transparent huge pages.
+ * The heap is then reserved 2 MiB-aligned with MADV_HUGEPAGE, it grows,
+ * shrinks and releases memory in whole huge pages, and small-object runs
+ * are packed into huge pages of their own.
+ */
+#ifndef MM_HUGEPAGES
+#define MM_HUGEPAGES 0
+#endif
+#define HUGE_PAGE_SIZE (2 * (1 << 20))  /* 2 MiB, a PMD-mapped page */
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
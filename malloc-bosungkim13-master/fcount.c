@@ -0,0 +1,196 @@
+/*
+ * fcount.c - Count hardware and software events of a function f with
+ *            perf_event_open()
+ *
+ * The events are split into groups of a few each.  The events of a group
+ * are opened as one perf group, so the kernel schedules them onto the
+ * PMU together and they count the same run of f.  Each selected group
+ * counts its own run of f, so no group has to share counters with
+ * another.  Only user-space events of the calling thread are counted.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "fcount.h"
+
+/* Most events in a group */
+#define FC_GROUP_MAX 4
+
+/* A cache event: a miss when reading through the given cache */
+#define FC_CACHE_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+			      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* How to open each event */
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} events[FC_EVENTS] = {
+    [FC_CYCLES] = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [FC_INSTRUCTIONS] = {"instructions", PERF_TYPE_HARDWARE,
+			 PERF_COUNT_HW_INSTRUCTIONS},
+    [FC_L1D_MISSES] = {"L1D misses", PERF_TYPE_HW_CACHE,
+		       FC_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    [FC_LLC_MISSES] = {"LLC misses", PERF_TYPE_HW_CACHE,
+		       FC_CACHE_MISS(PERF_COUNT_HW_CACHE_LL)},
+    [FC_DTLB_MISSES] = {"dTLB misses", PERF_TYPE_HW_CACHE,
+			FC_CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    [FC_BRANCHES] = {"branches", PERF_TYPE_HARDWARE,
+		     PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    [FC_BRANCH_MISSES] = {"branch misses", PERF_TYPE_HARDWARE,
+			  PERF_COUNT_HW_BRANCH_MISSES},
+    [FC_TASK_CLOCK] = {"task clock (ns)", PERF_TYPE_SOFTWARE,
+		       PERF_COUNT_SW_TASK_CLOCK},
+    [FC_PAGE_FAULTS] = {"page faults", PERF_TYPE_SOFTWARE,
+			PERF_COUNT_SW_PAGE_FAULTS},
+    [FC_CTX_SWITCHES] = {"context switches", PERF_TYPE_SOFTWARE,
+			 PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+
+/* The groups that init_fcount() selects from, and their counters */
+static struct {
+    const char *name;
+    int events[FC_GROUP_MAX];
+    int num_events;
+    int selected;
+    int fds[FC_GROUP_MAX];      /* -1 if the event couldn't be opened */
+    int leader;                 /* the first fd that opened, or -1 */
+    int num_open;
+} groups[] = {
+    {"ipc", {FC_CYCLES, FC_INSTRUCTIONS}, 2, 0, {0}, -1, 0},
+    {"cache", {FC_L1D_MISSES, FC_LLC_MISSES}, 2, 0, {0}, -1, 0},
+    {"tlb", {FC_DTLB_MISSES}, 1, 0, {0}, -1, 0},
+    {"branch", {FC_BRANCHES, FC_BRANCH_MISSES}, 2, 0, {0}, -1, 0},
+    {"sw", {FC_TASK_CLOCK, FC_PAGE_FAULTS, FC_CTX_SWITCHES}, 3, 0, {0}, -1, 0},
+};
+#define NUM_GROUPS ((int)(sizeof(groups) / sizeof(groups[0])))
+
+/* function prototypes */
+static int open_event(int event, int leader);
+static void open_group(int g);
+static void read_group(int g, fcount_t *out);
+
+/*
+ * init_fcount - Select the comma-separated groups, or "all" of them, and
+ *     open their counters.  Return -1 if a group name is unknown.
+ */
+int init_fcount(char *names)
+{
+    char buf[256], *name;
+    int g;
+
+    snprintf(buf, sizeof(buf), "%s", names);
+    for (name = strtok(buf, ","); name != NULL; name = strtok(NULL, ",")) {
+	for (g = 0; g < NUM_GROUPS; g++)
+	    if (strcmp(name, "all") == 0 || strcmp(name, groups[g].name) == 0)
+		groups[g].selected = 1;
+	for (g = 0; g < NUM_GROUPS; g++)
+	    if (strcmp(name, "all") == 0 || strcmp(name, groups[g].name) == 0)
+		break;
+	if (g == NUM_GROUPS)
+	    return -1;
+    }
+    for (g = 0; g < NUM_GROUPS; g++)
+	if (groups[g].selected)
+	    open_group(g);
+    return 0;
+}
+
+/*
+ * fcount_name - Return the name of an event
+ */
+const char *fcount_name(int event)
+{
+    return events[event].name;
+}
+
+/*
+ * fcount - Count the events of the selected groups, running f(argp) once
+ *     per group with only that group's counters enabled
+ */
+void fcount(fcount_test_funct f, void *argp, fcount_t *out)
+{
+    int g;
+
+    memset(out, 0, sizeof(*out));
+    for (g = 0; g < NUM_GROUPS; g++) {
+	if (groups[g].leader < 0)
+	    continue;
+	ioctl(groups[g].leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(groups[g].leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	f(argp);
+	ioctl(groups[g].leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	read_group(g, out);
+    }
+}
+
+/*
+ * open_event - Open a disabled counter of the event in the calling
+ *     thread's user-space execution, in the group of the leader's fd
+ *     (-1 to start a group).  Return its fd, or -1 if it can't be counted.
+ */
+static int open_event(int event, int leader)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[event].type;
+    attr.config = events[event].config;
+    attr.disabled = (leader < 0);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+	PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+/*
+ * open_group - Open the counters of a group, leaving out the events that
+ *     the machine can't count
+ */
+static void open_group(int g)
+{
+    int i, fd;
+
+    for (i = 0; i < groups[g].num_events; i++) {
+	fd = open_event(groups[g].events[i], groups[g].leader);
+	groups[g].fds[i] = fd;
+	if (fd < 0) {
+	    fprintf(stderr, "Can't count %s on this machine\n",
+		    events[groups[g].events[i]].name);
+	    continue;
+	}
+	if (groups[g].leader < 0)
+	    groups[g].leader = fd;
+	groups[g].num_open++;
+    }
+}
+
+/*
+ * read_group - Read a group's counts into out.  The counts come in the
+ *     order the events were opened, and are scaled up if the group was
+ *     only on the PMU for part of the run.
+ */
+static void read_group(int g, fcount_t *out)
+{
+    uint64_t buf[3 + FC_GROUP_MAX];  /* nr, time enabled, time running, ... */
+    double scale;
+    int i, n;
+
+    if (read(groups[g].leader, buf, sizeof(buf)) <
+	(ssize_t)((3 + groups[g].num_open) * sizeof(uint64_t)) ||
+	buf[0] != (uint64_t)groups[g].num_open || buf[2] == 0)
+	return;
+    scale = (double)buf[1] / buf[2];
+    for (i = 0, n = 0; i < groups[g].num_events; i++) {
+	if (groups[g].fds[i] < 0)
+	    continue;
+	out->counts[groups[g].events[i]] = buf[3 + n++] * scale;
+	out->valid |= 1u << groups[g].events[i];
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ * Event counters of a function, from the kernel's perf_event_open()
+ */
+typedef void (*fcount_test_funct)(void *);
+
+/* The events, in groups that are counted together */
+enum {
+    FC_CYCLES, FC_INSTRUCTIONS,        /* "ipc" */
+    FC_L1D_MISSES, FC_LLC_MISSES,      /* "cache" */
+    FC_DTLB_MISSES,                    /* "tlb" */
+    FC_BRANCHES, FC_BRANCH_MISSES,     /* "branch" */
+    FC_TASK_CLOCK, FC_PAGE_FAULTS,     /* "sw" */
+    FC_CTX_SWITCHES,
+    FC_EVENTS
+};
+
+/* The counts of one run of the function */
+typedef struct {
+    double counts[FC_EVENTS];  /* scaled if an event shared its counter */
+    unsigned valid;            /* bit i is set iff counts[i] was counted */
+} fcount_t;
+
+/* Open the counters of the comma-separated groups, or of "all" of them.
+   Return -1 if a group is unknown, and print the events that the machine
+   can't count */
+int init_fcount(char *groups);
+
+/* Return the name of an event, for printing */
+const char *fcount_name(int event);
+
+/* Count the events of one run of f(argp), one group per run */
+void fcount(fcount_test_funct f, void *argp, fcount_t *out);
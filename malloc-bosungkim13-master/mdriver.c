@@ -15,11 +15,22 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <limits.h>
+#include <math.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "fcount.h"
+#include "clock.h"
+#include "trace.h"
 #include "config.h"
 
 /**********************
@@ -31,26 +42,90 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/*
+ * Latency histograms are log-linear: values below LAT_SUBS have a bucket
+ * each, and every power of two above that is split into LAT_SUBS buckets
+ */
+#define LAT_SUB_BITS 4
+#define LAT_SUBS     (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS  ((64 - LAT_SUB_BITS + 1) * LAT_SUBS)
+#define LAT_TRIES    100  /* tries when measuring the timing overhead */
+#define LAT_STATS    6    /* count, p50, p90, p99, p99.9 and max of a type */
+
+/*
+ * A throughput change against a -r baseline is a regression when it is
+ * significant by Welch's t-test at the 95% level and larger than
+ * THRU_TOLERANCE.  Utilization is deterministic, so any drop of more than
+ * UTIL_TOLERANCE is one.
+ */
+#define THRU_TOLERANCE 0.02
+#define UTIL_TOLERANCE 0.001
+
+/*
+ * The free list bins that -B picks.  These must match mm.c, which checks
+ * them against its own constants when it is built with the table.
+ */
+#define BIN_ALIGN    16          /* mm.c's ALIGN */
+#define BIN_SLAB_MAX 64          /* larger requests than this use the bins */
+#define BIN_LIMIT    (64 * 1024) /* blocks this large always go in the tree */
+#define BIN_CELLS    1024        /* most places considered for bin starts */
+
+/* The block size that mm.c's adjust_size() makes of a request's size */
+#define BIN_SIZE(s) ((s) <= 24 ? 32 : BIN_ALIGN * (((s) + 8 + BIN_ALIGN - 1) / \
+						    BIN_ALIGN))
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
+/* Most consecutive ops that eval_mm_valid() serves with one batch call */
+#define BATCH_MAX 16
+
+/* Number of range structs that are allocated from libc at a time */
+#define RANGE_CHUNK 4096
+
+/* Treap priority of range p, a hash of its address */
+#define RANGE_PRIO(p) ((uintptr_t)(p)->lo * (uintptr_t)0x9E3779B97F4A7C15ULL)
+
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/*
+ * Records the extent of each block's payload.  The ranges form a treap
+ * ordered by address, so overlaps are found in O(log n) time.
+ */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* ranges at lower addresses (or next free) */
+    struct range_t *right; /* ranges at higher addresses */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/* A block of range structs, carved up before more are allocated */
+typedef struct range_chunk_t {
+    struct range_chunk_t *next;    /* previously allocated chunk */
+    unsigned used;                 /* number of structs handed out */
+    range_t ranges[RANGE_CHUNK];
+} range_chunk_t;
+
+/*
+ * Maps the addresses of the live blocks of a recorded log to trace ids.
+ * It is an open-addressed hash table with linear probing.  Ids of freed
+ * blocks are reused, so the trace has as many ids as the program ever
+ * had live blocks.
+ */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
+    uint64_t *addrs;      /* address in each slot, 0 if the slot is empty */
+    uint32_t *ids;        /* id of the block in each slot */
+    size_t mask;          /* slots - 1, slots being a power of two */
+    size_t used;          /* slots in use */
+    uint32_t *free_ids;   /* stack of ids that can be reused... */
+    uint32_t num_free;    /* ... holding this many */
+    uint32_t num_ids;     /* ids handed out so far */
+} idmap_t;
+
+#define NO_ID UINT32_MAX
+#define IDMAP_SLOT(m, a) (((a) * 0x9E3779B97F4A7C15ULL >> 16) & (m)->mask)
 
 /* Holds the information for one trace file*/
 typedef struct {
@@ -61,8 +136,35 @@ typedef struct {
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapping of a binary trace file, or NULL */
+    size_t map_size;     /* length of that mapping */
+    unsigned *leftovers; /* ids of the blocks that are never freed... */
+    unsigned num_leftovers; /* ... and how many there are */
 } trace_t;
 
+/*
+ * An allocator that the driver can test and time.  The driver runs every
+ * allocator that -m selects on each trace, so their results can be put
+ * side by side.
+ */
+typedef struct {
+    char *name;                         /* name that -m selects it by */
+    int (*init)(void);                  /* start over with an empty heap */
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void (*free_sized)(void *ptr, size_t size); /* or NULL */
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+    void *(*memalign)(size_t alignment, size_t size);
+    size_t (*malloc_batch)(size_t size, size_t n, void **out); /* or NULL */
+    void (*free_batch)(void **ptrs, size_t n); /* or NULL */
+    size_t (*heapsize)(void);           /* peak heap size, or NULL if it
+					   doesn't allocate from memlib */
+    void (*set_check)(unsigned int interval, mm_check_fail_t fail);
+					/* heap checker, or NULL */
+    int threads;                        /* safe to call from many threads */
+} backend_t;
+
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -73,16 +175,50 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/*
+ * Holds the state of one thread of a multithreaded replay.  Each thread
+ * replays the whole trace.  It allocates into its own blocks array but
+ * reallocs and frees the blocks in "victims", which is another thread's
+ * array when frees are cross-thread.
+ */
+typedef struct {
+    trace_t *trace;
+    char **blocks;           /* blocks this thread allocated, by id */
+    char **victims;          /* blocks this thread reallocs and frees */
+    pthread_barrier_t *start; /* lets every thread start at once */
+    struct timespec begin;   /* when this thread started its replay */
+    struct timespec end;     /* ... and when it finished */
+    int failed;              /* set if the allocator ran out of memory */
+    int *abort;              /* shared; set once any thread has failed */
+} replay_t;
+
+/* Latency histogram of one type of request, in cycles */
+typedef struct {
+    uint64_t count;               /* number of requests timed */
+    uint64_t max;                 /* slowest one */
+    uint64_t buckets[LAT_BUCKETS];
+} lathist_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
-    /* defined for both libc malloc and student malloc package (mm.c) */
+    /* defined for every backend */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
 
-    /* defined only for the student malloc package */
+    /* defined only for backends that allocate from memlib's heap */
     double util;     /* space utilization for this trace (always 0 for libc) */
 
+    /* defined only with -p */
+    fcount_t counts; /* events of one run of the trace */
+
+    /* defined only with -l */
+    int has_lat;     /* were the latencies measured? */
+    double lat[3][LAT_STATS]; /* by request type: count, percentiles, max */
+
+    double *samples; /* secs of each of -k runs of the trace */
+    int num_samples; /* ... of which secs is the mean */
+
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
@@ -92,10 +228,57 @@ typedef struct {
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
+static range_chunk_t *range_chunks = NULL; /* pool of range structs */
+static range_t *free_ranges = NULL;        /* returned range structs */
+static unsigned check_interval = 0; /* ops between heap slice checks (-c) */
+static int check_failed = 0;        /* set when the heap checker failed */
+static char check_msg[MAXLINE];     /* the first failure it reported */
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/*
+ * Builds of mm.c with other settings, which name their functions with a
+ * prefix instead of "mm" (see mm.h)
+ */
+#define MM_VARIANT(p)							\
+    int p##_init(void);							\
+    void *p##_malloc(size_t size);					\
+    void p##_free(void *ptr);						\
+    void p##_free_sized(void *ptr, size_t size);			\
+    void *p##_realloc(void *ptr, size_t size);				\
+    void *p##_calloc(size_t nmemb, size_t size);			\
+    void *p##_memalign(size_t alignment, size_t size);			\
+    size_t p##_malloc_batch(size_t size, size_t n, void **out);		\
+    void p##_free_batch(void **ptrs, size_t n);				\
+    void p##_set_check(unsigned int interval, mm_check_fail_t fail);
+
+MM_VARIANT(mm_noquick)
+MM_VARIANT(mm_nothreads)
+
+static int libc_init(void);
+
+/* The allocators that -m can select */
+static backend_t backends[] = {
+    {"mm", mm_init, mm_malloc, mm_free, mm_free_sized, mm_realloc,
+     mm_calloc, mm_memalign, mm_malloc_batch, mm_free_batch,
+     mem_peak_heapsize, mm_set_check, MM_THREADS},
+    {"mm-noquick", mm_noquick_init, mm_noquick_malloc, mm_noquick_free,
+     mm_noquick_free_sized, mm_noquick_realloc, mm_noquick_calloc,
+     mm_noquick_memalign, mm_noquick_malloc_batch, mm_noquick_free_batch,
+     mem_peak_heapsize, mm_noquick_set_check, MM_THREADS},
+    {"mm-nothreads", mm_nothreads_init, mm_nothreads_malloc,
+     mm_nothreads_free, mm_nothreads_free_sized, mm_nothreads_realloc,
+     mm_nothreads_calloc, mm_nothreads_memalign, mm_nothreads_malloc_batch,
+     mm_nothreads_free_batch, mem_peak_heapsize, mm_nothreads_set_check, 0},
+    {"libc", libc_init, malloc, free, NULL, realloc, calloc, aligned_alloc,
+     NULL, NULL, NULL, NULL, 1},
+};
+#define NUM_BACKENDS ((int)(sizeof(backends) / sizeof(backends[0])))
+
+/* The allocator being evaluated */
+static backend_t *be = &backends[0];
+
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {  
     DEFAULT_TRACEFILES, NULL
@@ -111,22 +294,59 @@ static int add_range(range_t **ranges, char *lo, int size,
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *new_range(void);
+static void split_ranges(range_t *t, char *lo, range_t **l, range_t **r);
+static range_t *merge_ranges(range_t *a, range_t *b);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static trace_t *map_trace(char *path);
+static trace_t *read_log(char *path);
+static size_t idmap_find(idmap_t *map, uint64_t addr);
+static void idmap_add(idmap_t *map, uint64_t addr, uint32_t id);
+static uint32_t idmap_remove(idmap_t *map, uint64_t addr);
+static uint32_t idmap_new_id(idmap_t *map);
+static void write_trace(trace_t *trace, char *path);
+static void write_bins(char *path, char **tracefiles, int num_tracefiles);
+static void find_leftovers(trace_t *trace);
+static void free_leftovers(trace_t *trace, char **blocks);
 static void free_trace(trace_t *trace);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
+static unsigned batch_run(trace_t *trace, unsigned i);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_threads(trace_t *trace, int max_threads, int cross);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static uint64_t read_counter(void);
+static uint64_t lat_ovhd(void);
+static void lat_add(lathist_t *hist, uint64_t cycles);
+static uint64_t lat_percentile(lathist_t *hist, double q);
+static void *replay_thread(void *arg);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printcounts(stats_t *stats);
+static void write_results(char *path, int n, int num_used, backend_t **used,
+			  char **tracefiles, stats_t *stats);
+static void write_json(FILE *file, int n, int num_used, backend_t **used,
+		       char **tracefiles, stats_t *stats);
+static void write_csv(FILE *file, int n, int num_used, backend_t **used,
+		      char **tracefiles, stats_t *stats);
+static void json_string(FILE *file, const char *str);
+static char **get_meta(void);
+static int compare_results(char *path, int n, int num_used, backend_t **used,
+			   char **tracefiles, stats_t *stats);
+static double t_crit(double df);
+static void printcompare(int n, int num_used, backend_t **used,
+			 stats_t *stats);
+static int select_backends(char *names, backend_t **used);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
+static void heap_check_failed(const char *msg, void *bp);
 static void app_error(char *msg);
 
 /**************
@@ -134,15 +354,29 @@ static void app_error(char *msg);
  **************/
 int main(int argc, char **argv)
 {
-    int i;
+    int i, b;
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
-    stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    stats_t *mm_stats = NULL;  /* stats for each backend and trace */
+    stats_t *st;               /* ... for the current backend and trace */
+    backend_t *used[NUM_BACKENDS] = {NULL}; /* the backends -m selected */
+    int num_used = 1;          /* the number of them */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
+    char *binfile = NULL; /* If set, write the trace there in binary (-b) */
+    char *binsfile = NULL; /* If set, write a bin table there (-B) */
+    int max_threads = 0; /* If set, also replay on 1..max_threads (-T) */
+    int cross = 0;       /* If set, threads free each other's blocks (-x) */
+    int latency = 0;     /* If set, print latency percentiles (-l) */
+    int counting = 0;    /* If set, count events with perf (-p) */
+    int runs = 1;        /* Times each trace is timed (-k) */
+    char *outfile = NULL; /* If set, write the results there (-o) */
+    char *basefile = NULL; /* If set, compare with these results (-r) */
+    int regressions = 0; /* Regressions found against basefile */
+    int k;
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
 
@@ -153,26 +387,78 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "gf:t:avVh")) != EOF) {
+    while ((c = getopt(argc, argv, "b:B:c:gf:k:lm:o:p:r:t:T:avVxh")) != EOF) {
         switch (c) {
+	case 'b': /* Convert the -f trace to a binary trace file and exit */
+	    binfile = optarg;
+	    break;
+	case 'B': /* Write a bin table tuned to the traces and exit */
+	    binsfile = optarg;
+	    break;
+	case 'c': /* Run the mm package's heap checker while checking traces */
+	    check_interval = atoi(optarg);
+	    if (check_interval == 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
 	    break;
-        case 'f': /* Use one specific trace file only (relative to curr dir) */
-            num_tracefiles = 1;
-            if ((tracefiles = realloc(tracefiles, 2*sizeof(char *))) == NULL)
+        case 'f': /* Use specific trace files only (relative to curr dir) */
+            num_tracefiles++;
+            if ((tracefiles = realloc(tracefiles,
+				      (num_tracefiles + 1)*sizeof(char *))) == NULL)
 		unix_error("ERROR: realloc failed in main");
 	    strcpy(tracedir, "./"); 
-            tracefiles[0] = strdup(optarg);
-            tracefiles[1] = NULL;
+            tracefiles[num_tracefiles - 1] = strdup(optarg);
+            tracefiles[num_tracefiles] = NULL;
             break;
+	case 'p': /* Count these groups of hardware events in each trace */
+	    if (init_fcount(optarg) < 0) {
+		usage();
+		exit(1);
+	    }
+	    counting = 1;
+	    break;
 	case 't': /* Directory where the traces are located */
-	    if (num_tracefiles == 1) /* ignore if -f already encountered */
+	    if (num_tracefiles > 0) /* ignore if -f already encountered */
 		break;
 	    strcpy(tracedir, optarg);
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+	case 'k': /* Time each trace this many times, for -r */
+	    if ((runs = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'o': /* Write the results as JSON, or CSV if the name ends .csv */
+	    outfile = optarg;
+	    break;
+	case 'r': /* Flag significant regressions against a -o CSV file */
+	    basefile = optarg;
+	    break;
+	case 'l': /* Print percentiles of the latency of each request type */
+	    latency = 1;
+	    break;
+	case 'm': /* Evaluate these allocators, side by side */
+	    if ((num_used = select_backends(optarg, used)) == 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'T': /* Replay each trace on 1, 2, ..., n threads at once */
+	    max_threads = atoi(optarg);
+	    if (max_threads < 1) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'x': /* Make the threads of -T free each other's blocks */
+	    cross = 1;
+	    break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
@@ -191,6 +477,39 @@ int main(int argc, char **argv)
         }
     }
 	
+    /*
+     * Convert a trace to the binary format without testing anything
+     */
+    if (binfile != NULL) {
+	if (num_tracefiles != 1) {
+	    usage();
+	    exit(1);
+	}
+	trace = read_trace(tracedir, tracefiles[0]);
+	write_trace(trace, binfile);
+	free_trace(trace);
+	exit(0);
+    }
+
+    /*
+     * Pick free list bins for the -f traces, or the default ones
+     */
+    if (binsfile != NULL) {
+	if (tracefiles == NULL) {
+	    tracefiles = default_tracefiles;
+	    num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
+	}
+	write_bins(binsfile, tracefiles, num_tracefiles);
+	exit(0);
+    }
+
+    if (num_used == 1 && used[0] == NULL)
+	used[0] = &backends[0];
+    for (b = 0; b < num_used; b++)
+	if (max_threads > 1 && !used[b]->threads)
+	    fprintf(stderr, "Not replaying on threads with %s, which "
+		    "isn't thread safe\n", used[b]->name);
+
     /* 
      * Check and print team info 
      */
@@ -230,49 +549,84 @@ int main(int argc, char **argv)
     /* Initialize the timing package */
     init_fsecs();
 
-    /*
-     * Always run and evaluate the student's mm package
-     */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
-
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
-    mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+    /* Allocate the stats array, with one stats_t struct per backend and
+       tracefile */
+    mm_stats = (stats_t *)calloc(num_used * num_tracefiles, sizeof(stats_t));
     if (mm_stats == NULL)
 	unix_error("mm_stats calloc in main failed");
     
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
+    /*
+     * Evaluate each backend using the K-best scheme.  Every backend runs
+     * a trace before the next trace is read, so they all see the same one.
+     */
     for (i=0; i < num_tracefiles; i++) {
 	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
+	find_leftovers(trace);
+	for (b = 0; b < num_used; b++) {
+	    be = used[b];
+	    st = &mm_stats[b * num_tracefiles + i];
+	    st->ops = trace->num_ops;
 	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+		printf("Checking %s for correctness, ", be->name);
+	    if (be->set_check != NULL)
+		be->set_check(check_interval, heap_check_failed);
+	    st->valid = eval_mm_valid(trace, i, &ranges);
+	    if (be->set_check != NULL)
+		be->set_check(0, NULL);
+	    if (st->valid) {
+		if (verbose > 1)
+		    printf("efficiency, ");
+		st->util = eval_mm_util(trace, i, &ranges);
+		speed_params.trace = trace;
+		speed_params.ranges = ranges;
+		if (verbose > 1)
+		    printf("and performance.\n");
+		if ((st->samples = calloc(runs, sizeof(double))) == NULL)
+		    unix_error("calloc failed in main");
+		st->num_samples = runs;
+		st->secs = 0;
+		for (k = 0; k < runs; k++) {
+		    st->samples[k] = fsecs(eval_mm_speed, &speed_params);
+		    st->secs += st->samples[k] / runs;
+		}
+		if (counting) {
+		    fcount(eval_mm_speed, &speed_params, &st->counts);
+		    printcounts(st);
+		}
+		if (latency)
+		    eval_mm_latency(trace, st);
+		if (max_threads > 0 && (max_threads == 1 || be->threads))
+		    eval_mm_threads(trace, max_threads, cross);
+	    }
 	}
 	free_trace(trace);
     }
 
-    /* Display the mm results in a compact table */
+    /* Display the results in a compact table per backend */
     if (verbose) {
-	printf("\nResults for mm malloc:\n");
-	printresults(num_tracefiles, mm_stats);
+	for (b = 0; b < num_used; b++) {
+	    printf("\nResults for %s malloc:\n", used[b]->name);
+	    printresults(num_tracefiles, &mm_stats[b * num_tracefiles]);
+	}
 	printf("\n");
     }
+    if (num_used > 1) {
+	printcompare(num_tracefiles, num_used, used, mm_stats);
+	printf("\n");
+    }
+    if (outfile != NULL)
+	write_results(outfile, num_tracefiles, num_used, used, tracefiles,
+		      mm_stats);
+    if (basefile != NULL)
+	regressions = compare_results(basefile, num_tracefiles, num_used,
+				      used, tracefiles, mm_stats);
 
     /* 
-     * Accumulate the aggregate statistics for the student's mm package 
+     * Accumulate the aggregate statistics for the first backend, which is
+     * the student's mm package unless -m picked another
      */
     secs = 0;
     ops = 0;
@@ -319,14 +673,18 @@ int main(int argc, char **argv)
 	printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    /* A gate can tell regressions from errors by the exit status */
+    exit(regressions > 0 ? 2 : 0);
 }
 
 
 /*****************************************************************
  * The following routines manipulate the range list, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range list to detect any overlapping allocated blocks.  The list
+ * is a treap ordered by address whose priorities are hashes of the
+ * addresses, so a new block only has to be compared with the ranges
+ * just before and after it.
  ****************************************************************/
 
 /*
@@ -339,7 +697,8 @@ static int add_range(range_t **ranges, char *lo, int size,
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *pred = NULL, *succ = NULL;
+    range_t **link;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -352,36 +711,47 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap or a mapping */
+    if (be->heapsize != NULL && !mem_is_heap(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
+    /* 
+     * The payload must not overlap any other payloads.  The ranges don't
+     * overlap each other, so only the nearest one on each side can.
+     */
+    for (p = *ranges;  p != NULL; ) {
+        if (p->lo <= lo) {
+            pred = p;
+            p = p->right;
+        } else {
+            succ = p;
+            p = p->left;
         }
     }
+    if (((p = pred) != NULL && p->hi >= lo) ||
+        ((p = succ) != NULL && p->lo <= hi)) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
      * by creating a range struct and adding it the range list.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = new_range();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    link = ranges;
+    while (*link != NULL && RANGE_PRIO(*link) > RANGE_PRIO(p))
+        link = (lo < (*link)->lo) ? &(*link)->left : &(*link)->right;
+    split_ranges(*link, lo, &p->left, &p->right);
+    *link = p;
     return 1;
 }
 
@@ -393,18 +763,15 @@ static int add_range(range_t **ranges, char *lo, int size,
 static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
-    range_t **prevpp = ranges;
-    //int size;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            //size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
-    }
+    range_t **link = ranges;
+
+    while ((p = *link) != NULL && p->lo != lo)
+        link = (lo < p->lo) ? &p->left : &p->right;
+    if (p == NULL)
+        return;
+    *link = merge_ranges(p->left, p->right);
+    p->left = free_ranges;
+    free_ranges = p;
 }
 
 /*
@@ -412,14 +779,77 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
+    range_t *p = *ranges;
+
+    if (p == NULL)
+        return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    p->left = free_ranges;
+    free_ranges = p;
+    *ranges = NULL;
+}
+
+/*
+ * new_range - Return an unused range struct, taking a new chunk of them
+ *     from libc only when every struct allocated so far is in use
+ */
+static range_t *new_range(void)
+{
+    range_chunk_t *chunk = range_chunks;
     range_t *p;
-    range_t *pnext;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+    if ((p = free_ranges) != NULL) {
+        free_ranges = p->left;
+        return p;
     }
-    *ranges = NULL;
+    if (chunk == NULL || chunk->used == RANGE_CHUNK) {
+        if ((chunk = (range_chunk_t *)malloc(sizeof(range_chunk_t))) == NULL)
+            unix_error("malloc error in new_range");
+        chunk->next = range_chunks;
+        chunk->used = 0;
+        range_chunks = chunk;
+    }
+    return &chunk->ranges[chunk->used++];
+}
+
+/*
+ * split_ranges - Split the treap t into the ranges below lo, stored in
+ *     *l, and the ranges above it, stored in *r
+ */
+static void split_ranges(range_t *t, char *lo, range_t **l, range_t **r)
+{
+    while (t != NULL) {
+        if (t->lo < lo) {
+            *l = t;
+            l = &t->right;
+            t = t->right;
+        } else {
+            *r = t;
+            r = &t->left;
+            t = t->left;
+        }
+    }
+    *l = NULL;
+    *r = NULL;
+}
+
+/*
+ * merge_ranges - Join the treaps a and b, where every range in a is
+ *     below every range in b, and return the root of the result
+ */
+static range_t *merge_ranges(range_t *a, range_t *b)
+{
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+    if (RANGE_PRIO(a) > RANGE_PRIO(b)) {
+        a->right = merge_ranges(a->right, b);
+        return a;
+    }
+    b->left = merge_ranges(a, b->left);
+    return b;
 }
 
 
@@ -428,7 +858,9 @@ static void clear_ranges(range_t **ranges)
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory.  A binary
+ *     trace file is recognized by its magic number and mapped instead,
+ *     and a log recorded by the malloc shim is converted.
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
@@ -436,6 +868,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
+    char magic[sizeof(BIN_MAGIC) - 1];
     unsigned index, size;
     unsigned max_index = 0;
     unsigned op_index;
@@ -443,17 +876,33 @@ static trace_t *read_trace(char *tracedir, char *filename)
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
 
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
     strcpy(path, tracedir);
     strcat(path, filename);
     if ((tracefile = fopen(path, "r")) == NULL) {
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
+    if (fread(magic, 1, sizeof(magic), tracefile) == sizeof(magic)) {
+	if (memcmp(magic, BIN_MAGIC, sizeof(magic)) == 0) {
+	    fclose(tracefile);
+	    return map_trace(path);
+	}
+	if (memcmp(magic, LOG_MAGIC, sizeof(magic)) == 0) {
+	    fclose(tracefile);
+	    return read_log(path);
+	}
+    }
+    rewind(tracefile);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in read_trance");
+    trace->map = NULL;
+    trace->map_size = 0;
+    trace->leftovers = NULL;
+    trace->num_leftovers = 0;
+	
+    /* Read the trace file header */
     fscanf(tracefile, "%u", &(trace->sugg_heapsize)); /* not used */
     fscanf(tracefile, "%u", &(trace->num_ids));     
     fscanf(tracefile, "%u", &(trace->num_ops));     
@@ -513,15 +962,555 @@ static trace_t *read_trace(char *tracedir, char *filename)
     return trace;
 }
 
+/*
+ * map_trace - map a binary trace file and use its ops in place.  Only the
+ *     arrays that the ops fill in are allocated.
+ */
+static trace_t *map_trace(char *path)
+{
+    int fd;
+    struct stat st;
+    trace_t *trace;
+    binhdr_t *hdr;
+    unsigned i;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	sprintf(msg, "Could not open %s in map_trace", path);
+	unix_error(msg);
+    }
+    if ((size_t)st.st_size < sizeof(binhdr_t)) {
+	sprintf(msg, "Binary trace %s is truncated", path);
+	app_error(msg);
+    }
+    if ((hdr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+	MAP_FAILED) {
+	sprintf(msg, "Could not map %s in map_trace", path);
+	unix_error(msg);
+    }
+    close(fd);
+    if (hdr->byte_order != BIN_BYTE_ORDER) {
+	sprintf(msg, "Binary trace %s has the wrong byte order", path);
+	app_error(msg);
+    }
+    if ((size_t)st.st_size != sizeof(binhdr_t) +
+	(size_t)hdr->num_ops * sizeof(traceop_t) || hdr->num_ids == 0) {
+	sprintf(msg, "Binary trace %s has a bad header", path);
+	app_error(msg);
+    }
+
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in map_trace");
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->ops = (traceop_t *)(hdr + 1);
+    trace->map = hdr;
+    trace->map_size = st.st_size;
+    trace->leftovers = NULL;
+    trace->num_leftovers = 0;
+
+    /*
+     * The ops aren't parsed, but they must not index past the arrays, and
+     * the ops are read-only, so a size that add_range() can't check
+     * rejects the trace rather than being mapped to one
+     */
+    for (i = 0; i < trace->num_ops; i++) {
+	if (trace->ops[i].type > REALLOC ||
+	    trace->ops[i].index >= trace->num_ids) {
+	    sprintf(msg, "Bogus op %u in binary trace %s", i, path);
+	    app_error(msg);
+	}
+	if (trace->ops[i].type != FREE &&
+	    (trace->ops[i].size == 0 || trace->ops[i].size > INT_MAX)) {
+	    sprintf(msg, "Op %u in binary trace %s has bad size %u", i, path,
+		    trace->ops[i].size);
+	    app_error(msg);
+	}
+    }
+
+    if ((trace->blocks = 
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 2 failed in map_trace");
+    if ((trace->block_sizes = 
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 3 failed in map_trace");
+    return trace;
+}
+
+/*
+ * read_log - turn a log recorded by the malloc shim into a trace.  The
+ *     records are put in the order of their sequence numbers and the
+ *     addresses are replaced by ids.  Threads claim a sequence number just
+ *     before a free and just after an allocation, but a realloc that
+ *     races with another thread can still appear to return a block that
+ *     is live.  That block is freed first, and frees of blocks that
+ *     aren't live are dropped, so the trace is always valid.
+ */
+static trace_t *read_log(char *path)
+{
+    int fd;
+    struct stat st;
+    loghdr_t *hdr;
+    logrec_t *recs, *rec;
+    trace_t *trace;
+    traceop_t *op;
+    idmap_t map;
+    uint32_t *order, id, prev;
+    size_t n, i;
+    uint64_t seq, max_seq = 0;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	sprintf(msg, "Could not open %s in read_log", path);
+	unix_error(msg);
+    }
+    if ((size_t)st.st_size < sizeof(loghdr_t) ||
+	(hdr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+	MAP_FAILED) {
+	sprintf(msg, "Could not map %s in read_log", path);
+	unix_error(msg);
+    }
+    close(fd);
+    if (hdr->byte_order != BIN_BYTE_ORDER) {
+	sprintf(msg, "Log %s has the wrong byte order", path);
+	app_error(msg);
+    }
+    recs = (logrec_t *)(hdr + 1);
+    n = (st.st_size - sizeof(loghdr_t)) / sizeof(logrec_t);
+    if (n > UINT32_MAX / 2) {
+	sprintf(msg, "Log %s has too many records", path);
+	app_error(msg);
+    }
+
+    /* Sequence numbers are dense except for requests that were lost */
+    for (i = 0; i < n; i++)
+	max_seq = (recs[i].seq > max_seq) ? recs[i].seq : max_seq;
+    if (max_seq >= UINT32_MAX) {
+	sprintf(msg, "Log %s has too many requests", path);
+	app_error(msg);
+    }
+    if ((order = (uint32_t *)malloc((max_seq + 1) * sizeof(uint32_t))) ==
+	NULL)
+	unix_error("malloc 1 failed in read_log");
+    memset(order, 0xff, (max_seq + 1) * sizeof(uint32_t));
+    for (i = 0; i < n; i++) {
+	if (recs[i].type > REALLOC || order[recs[i].seq] != NO_ID) {
+	    sprintf(msg, "Bogus record %zu in log %s", i, path);
+	    app_error(msg);
+	}
+	order[recs[i].seq] = i;
+    }
+
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc 2 failed in read_log");
+    trace->sugg_heapsize = 0;
+    trace->weight = 1;
+    trace->map = NULL;
+    trace->map_size = 0;
+    trace->leftovers = NULL;
+    trace->num_leftovers = 0;
+    /* Every record makes at most a free and one other op */
+    if ((trace->ops =
+	 (traceop_t *)malloc((2 * n + 1) * sizeof(traceop_t))) == NULL)
+	unix_error("malloc 3 failed in read_log");
+
+    memset(&map, 0, sizeof(map));
+    map.mask = 1023;
+    if ((map.addrs = (uint64_t *)calloc(map.mask + 1, sizeof(uint64_t))) ==
+	NULL ||
+	(map.ids = (uint32_t *)malloc((map.mask + 1) * sizeof(uint32_t))) ==
+	NULL)
+	unix_error("malloc 4 failed in read_log");
+
+    op = trace->ops;
+    for (seq = 0; seq <= max_seq && n > 0; seq++) {
+	if (order[seq] == NO_ID)
+	    continue;
+	rec = &recs[order[seq]];
+	id = NO_ID;
+	if (rec->type == FREE) {
+	    if ((id = idmap_remove(&map, rec->addr)) != NO_ID) {
+		op->type = FREE;
+		op->index = id;
+		op++;
+		map.free_ids[map.num_free++] = id;
+	    }
+	    continue;
+	}
+	if (rec->type == REALLOC && rec->old != 0)
+	    id = idmap_remove(&map, rec->old);
+	if ((prev = idmap_remove(&map, rec->addr)) != NO_ID) {
+	    op->type = FREE;
+	    op->index = prev;
+	    op++;
+	    map.free_ids[map.num_free++] = prev;
+	}
+	op->type = (id == NO_ID) ? ALLOC : REALLOC;
+	if (id == NO_ID)
+	    id = idmap_new_id(&map);
+	op->index = id;
+	op->size = rec->size ? rec->size : 1;
+	op++;
+	idmap_add(&map, rec->addr, id);
+    }
+    trace->num_ops = op - trace->ops;
+    trace->num_ids = map.num_ids ? map.num_ids : 1;
+    free(map.addrs);
+    free(map.ids);
+    free(map.free_ids);
+    free(order);
+    munmap(hdr, st.st_size);
+
+    if ((trace->blocks = 
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 5 failed in read_log");
+    if ((trace->block_sizes = 
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 6 failed in read_log");
+    return trace;
+}
+
+/*
+ * idmap_find - Return the slot that holds addr, or the empty slot where
+ *     it would go
+ */
+static size_t idmap_find(idmap_t *map, uint64_t addr)
+{
+    size_t i = IDMAP_SLOT(map, addr);
+
+    while (map->addrs[i] != 0 && map->addrs[i] != addr)
+	i = (i + 1) & map->mask;
+    return i;
+}
+
+/*
+ * idmap_add - Map addr, which isn't mapped, to id.  The table doubles
+ *     when it is half full.
+ */
+static void idmap_add(idmap_t *map, uint64_t addr, uint32_t id)
+{
+    idmap_t old = *map;
+    size_t i;
+
+    if (2 * (map->used + 1) > map->mask + 1) {
+	map->mask = 2 * map->mask + 1;
+	map->used = 0;
+	if ((map->addrs = (uint64_t *)calloc(map->mask + 1,
+					     sizeof(uint64_t))) == NULL ||
+	    (map->ids = (uint32_t *)malloc((map->mask + 1) *
+					   sizeof(uint32_t))) == NULL)
+	    unix_error("malloc failed in idmap_add");
+	for (i = 0; i <= old.mask; i++) {
+	    if (old.addrs[i] != 0)
+		idmap_add(map, old.addrs[i], old.ids[i]);
+	}
+	free(old.addrs);
+	free(old.ids);
+    }
+    i = idmap_find(map, addr);
+    map->addrs[i] = addr;
+    map->ids[i] = id;
+    map->used++;
+}
+
+/*
+ * idmap_remove - Unmap addr and return its id, or NO_ID if it wasn't
+ *     mapped.  The entries after it in its probe sequence are shifted
+ *     back, so the table never needs tombstones.
+ */
+static uint32_t idmap_remove(idmap_t *map, uint64_t addr)
+{
+    size_t i = idmap_find(map, addr), j, home;
+    uint32_t id = map->ids[i];
+
+    if (map->addrs[i] == 0)
+	return NO_ID;
+    for (j = (i + 1) & map->mask; map->addrs[j] != 0;
+	 j = (j + 1) & map->mask) {
+	/* An entry can move back to i unless its home is in (i, j] */
+	home = IDMAP_SLOT(map, map->addrs[j]);
+	if (((j - home) & map->mask) >= ((j - i) & map->mask)) {
+	    map->addrs[i] = map->addrs[j];
+	    map->ids[i] = map->ids[j];
+	    i = j;
+	}
+    }
+    map->addrs[i] = 0;
+    map->used--;
+    return id;
+}
+
+/*
+ * idmap_new_id - Reuse the most recently freed id, or hand out a new one.
+ *     The stack of free ids grows along with the number of ids.
+ */
+static uint32_t idmap_new_id(idmap_t *map)
+{
+    if (map->num_free > 0)
+	return map->free_ids[--map->num_free];
+    if ((map->num_ids & (map->num_ids - 1)) == 0 &&
+	(map->free_ids = (uint32_t *)realloc(map->free_ids,
+	    2 * (map->num_ids + 1) * sizeof(uint32_t))) == NULL)
+	unix_error("realloc failed in idmap_new_id");
+    return map->num_ids++;
+}
+
+/*
+ * write_trace - write a trace to the file path in the binary format
+ */
+static void write_trace(trace_t *trace, char *path)
+{
+    FILE *binfile;
+    binhdr_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BIN_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = BIN_BYTE_ORDER;
+    hdr.sugg_heapsize = trace->sugg_heapsize;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.weight = trace->weight;
+
+    if ((binfile = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in write_trace", path);
+	unix_error(msg);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, binfile) != 1 ||
+	fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, binfile) !=
+	trace->num_ops || fclose(binfile) != 0) {
+	sprintf(msg, "Could not write %s in write_trace", path);
+	unix_error(msg);
+    }
+}
+
+/*
+ * write_bins - Pick free list bins for mm.c that suit the requests of the
+ *     traces, and write them to the file path as a table for mm.c to
+ *     build with.  The tree bin takes the largest block sizes, about one
+ *     bin's share of the requests.  The list bins below it are chosen by
+ *     dynamic programming to minimize the total, over requests, of the
+ *     distance from the request's block size up to the largest requested
+ *     size in its bin.  That bounds the slack of the block a request gets
+ *     from its own bin, and the sizes of blocks a search steps over, so
+ *     a bin that holds only one popular size costs nothing.
+ */
+static void write_bins(char *path, char **tracefiles, int num_tracefiles)
+{
+    static double hist[BIN_LIMIT / BIN_ALIGN]; /* requests by block size */
+    unsigned start[2 * BIN_CELLS];  /* first block size of each cell... */
+    unsigned top[2 * BIN_CELLS];    /* ... its largest requested size */
+    double pmass[2 * BIN_CELLS + 1]; /* requests in cells before each one */
+    double psum[2 * BIN_CELLS + 1];  /* ... and the sum of their sizes */
+    unsigned bounds[MM_STATS_BINS]; /* first block size of each bin */
+    int nbins = MM_STATS_BINS - 1;  /* list bins, below the tree bin */
+    double *cost, c, total = 0, tail, list, slack, step, next, n = 0;
+    int *from, i, j, g, groups, cells = 0;
+    unsigned limit, x, size;
+    trace_t *trace;
+    FILE *file;
+
+    /* Count the requests of each block size */
+    for (i = 0; i < num_tracefiles; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	for (j = 0; j < (int)trace->num_ops; j++) {
+	    if (trace->ops[j].type == FREE ||
+		trace->ops[j].size <= BIN_SLAB_MAX)
+		continue;
+	    size = BIN_SIZE(trace->ops[j].size);
+	    if (size < BIN_LIMIT)
+		hist[size / BIN_ALIGN]++;
+	    total++;
+	}
+	free_trace(trace);
+    }
+    if (total == 0)
+	app_error("The traces have no requests that use the free lists");
+
+    /* The tree bin takes the largest sizes */
+    tail = total;
+    for (x = 0; x < BIN_LIMIT / BIN_ALIGN; x++)
+	tail -= hist[x];
+    for (limit = BIN_LIMIT / BIN_ALIGN;
+	 limit > BIN_SLAB_MAX / BIN_ALIGN + 1 &&
+	     tail + hist[limit - 1] <= total / MM_STATS_BINS; limit--)
+	tail += hist[limit - 1];
+
+    /*
+     * Group the sizes below it into cells of about equal numbers of
+     * requests, each popular size getting a cell of its own, if there
+     * are too many sizes to give every one a cell
+     */
+    for (x = 0; x < limit; x++)
+	n += hist[x] > 0;
+    step = (total - tail) / BIN_CELLS;
+    next = 0;
+    pmass[0] = psum[0] = 0;
+    for (x = 0, c = 0; x < limit; x++) {
+	if (hist[x] == 0)
+	    continue;
+	if (cells == 0 || n <= BIN_CELLS || c >= next || hist[x] >= step) {
+	    start[cells] = x * BIN_ALIGN;
+	    pmass[cells + 1] = pmass[cells];
+	    psum[cells + 1] = psum[cells];
+	    cells++;
+	    while (next <= c)
+		next += step;
+	}
+	top[cells - 1] = x * BIN_ALIGN;
+	pmass[cells] += hist[x];
+	psum[cells] += hist[x] * x * BIN_ALIGN;
+	c += hist[x];
+    }
+
+    /*
+     * cost[g * (cells + 1) + i] is the least cost of splitting the first
+     * i cells into g bins, and from[...] where the last of them starts
+     */
+    groups = (cells < nbins) ? cells : nbins;
+    list = total - tail;
+    if ((cost = malloc((groups + 1) * (cells + 1) * sizeof(double))) == NULL ||
+	(from = malloc((groups + 1) * (cells + 1) * sizeof(int))) == NULL)
+	unix_error("malloc failed in write_bins");
+    for (i = 0; i <= cells; i++)
+	cost[i] = (i == 0) ? 0 : DBL_MAX;
+    for (g = 1; g <= groups; g++) {
+	for (i = 0; i <= cells; i++) {
+	    cost[g * (cells + 1) + i] = DBL_MAX;
+	    for (j = g - 1; j < i; j++) {
+		if (cost[(g - 1) * (cells + 1) + j] == DBL_MAX)
+		    continue;
+		c = cost[(g - 1) * (cells + 1) + j] +
+		    top[i - 1] * (pmass[i] - pmass[j]) - (psum[i] - psum[j]);
+		if (c < cost[g * (cells + 1) + i]) {
+		    cost[g * (cells + 1) + i] = c;
+		    from[g * (cells + 1) + i] = j;
+		}
+	    }
+	}
+    }
+
+    slack = (list > 0) ? cost[groups * (cells + 1) + cells] / list : 0;
+    for (g = groups, i = cells; g > 0; g--) {
+	i = from[g * (cells + 1) + i];
+	bounds[g - 1] = (g == 1) ? 0 : start[i];
+    }
+    bounds[groups] = limit * BIN_ALIGN;
+
+    /*
+     * Bins that the requests didn't need split the widest bins in two at
+     * the geometric mean of their bounds, since coalesced blocks of every
+     * size still go in them
+     */
+    while (groups < nbins) {
+	for (g = 0, j = -1, c = 1; g < groups; g++) {
+	    tail = (double)bounds[g + 1] / ((bounds[g] > 32) ? bounds[g] : 32);
+	    if (tail > c && bounds[g + 1] - bounds[g] > BIN_ALIGN) {
+		j = g;
+		c = tail;
+	    }
+	}
+	if (j < 0)
+	    break;
+	x = (unsigned)sqrt((double)bounds[j + 1] *
+			   ((bounds[j] > 32) ? bounds[j] : 32));
+	x = (x + BIN_ALIGN / 2) / BIN_ALIGN * BIN_ALIGN;
+	if (x <= bounds[j])
+	    x = bounds[j] + BIN_ALIGN;
+	if (x >= bounds[j + 1])
+	    x = bounds[j + 1] - BIN_ALIGN;
+	memmove(&bounds[j + 2], &bounds[j + 1],
+		(groups - j) * sizeof(bounds[0]));
+	bounds[j + 1] = x;
+	groups++;
+    }
+    for (g = groups + 1; g <= nbins; g++) /* left empty below the tree */
+	bounds[g] = limit * BIN_ALIGN;
+
+    if ((file = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in write_bins", path);
+	unix_error(msg);
+    }
+    fprintf(file, "/*\n * Free list bins for mm.c, made by \"mdriver -B\" "
+	    "from these traces:\n");
+    for (i = 0; i < num_tracefiles; i++)
+	fprintf(file, " *\t%s%s\n", tracedir, tracefiles[i]);
+    fprintf(file, " * The smallest block size of each bin, in bytes:\n *\t");
+    for (g = 0; g <= nbins; g++)
+	fprintf(file, "%u%s", bounds[g],
+		(g == nbins) ? "\n" : (g % 8 == 7) ? "\n *\t" : " ");
+    fprintf(file, " * Build it into mm.c with \"make BINS=%s\".\n */\n", path);
+    fprintf(file, "#define BIN_NUM       %d\n", MM_STATS_BINS);
+    fprintf(file, "#define BIN_ALIGN     %d\n", BIN_ALIGN);
+    fprintf(file, "#define BIN_SLAB_MAX  %d\n", BIN_SLAB_MAX);
+    fprintf(file, "#define BIN_TABLE_MAX %u /* Larger blocks go in the tree */\n\n",
+	    limit * BIN_ALIGN);
+    fprintf(file, "static const unsigned char "
+	    "bin_table[BIN_TABLE_MAX / BIN_ALIGN] = {");
+    for (x = 0, g = 0; x < limit; x++) {
+	while (g < nbins - 1 && bounds[g + 1] <= x * BIN_ALIGN)
+	    g++;
+	fprintf(file, "%s%d,", (x % 16 == 0) ? "\n\t" : " ", g);
+    }
+    fprintf(file, "\n};\n");
+    if (fclose(file) != 0) {
+	sprintf(msg, "Could not write %s in write_bins", path);
+	unix_error(msg);
+    }
+    printf("Wrote %s: list bins below %u bytes, mean slack %.1f bytes\n",
+	   path, limit * BIN_ALIGN,
+	   slack);
+    free(cost);
+    free(from);
+}
+
+/*
+ * find_leftovers - Find the ids of the blocks that the trace never frees
+ */
+static void find_leftovers(trace_t *trace)
+{
+    unsigned char *live;
+    unsigned i;
+
+    if ((live = calloc(trace->num_ids, 1)) == NULL ||
+	(trace->leftovers = malloc(trace->num_ids * sizeof(unsigned))) == NULL)
+	unix_error("malloc failed in find_leftovers");
+    for (i = 0; i < trace->num_ops; i++)
+	live[trace->ops[i].index] = (trace->ops[i].type != FREE);
+    trace->num_leftovers = 0;
+    for (i = 0; i < trace->num_ids; i++)
+	if (live[i])
+	    trace->leftovers[trace->num_leftovers++] = i;
+    free(live);
+}
+
+/*
+ * free_leftovers - Free the blocks that a replay of the trace left
+ *     allocated, if the backend can't start over with an empty heap
+ */
+static void free_leftovers(trace_t *trace, char **blocks)
+{
+    unsigned i;
+
+    if (be->heapsize != NULL)
+	return;
+    for (i = 0; i < trace->num_leftovers; i++)
+	be->free(blocks[trace->leftovers[i]]);
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated in read_trace().  The ops
+ *              of a binary trace are unmapped instead.
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map != NULL)
+	munmap(trace->map, trace->map_size);
+    else
+	free(trace->ops);     /* free the three arrays... */
     free(trace->blocks);      
     free(trace->block_sizes);
+    free(trace->leftovers);
     free(trace);              /* and the trace record itself... */
 }
 
@@ -535,20 +1524,22 @@ void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    unsigned i, j;
-    int index;
+    unsigned i, j, n;
+    int index, calloced;
+    size_t align;
     unsigned size;
     unsigned oldsize;
     char *newp;
     char *oldp;
     char *p;
+    void *batch[BATCH_MAX];
     
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (be->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -562,11 +1553,60 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         case ALLOC: /* mm_malloc */
 
-	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+	    /* A run of allocs of one size that starts with an odd id is
+	       served by one mm_malloc_batch, and its blocks are checked
+	       one by one like those of mm_malloc */
+	    if (be->malloc_batch != NULL && index % 2 == 1 &&
+		(n = batch_run(trace, i)) > 1) {
+		if (be->malloc_batch(size, n, batch) != n) {
+		    malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		    return 0;
+		}
+		for (j = 0; j < n; j++, i++) {
+		    index = trace->ops[i].index;
+		    p = batch[j];
+		    if (add_range(ranges, p, size, tracenum, i) == 0)
+			return 0;
+		    memset(p, index & 0xFF, size);
+		    trace->blocks[index] = p;
+		    trace->block_sizes[index] = size;
+		}
+		i--;
+		break;
+	    }
+
+	    /* Call the student's malloc, or for every third id calloc,
+	       whose block must read as zero before it is written to, or
+	       for some other ids memalign, with alignments of 16 bytes
+	       to 4 KiB */
+	    calloced = be->calloc != NULL && index % 3 == 2;
+	    align = (!calloced && be->memalign != NULL && index % 5 == 3) ?
+		(size_t)16 << (index / 5 % 9) : 0;
+	    if (calloced)
+		p = be->calloc(1, size);
+	    else if (align != 0)
+		p = be->memalign(align, size);
+	    else
+		p = be->malloc(size);
+	    if (p == NULL) {
+		malloc_error(tracenum, i, calloced ? "mm_calloc failed." :
+			     align != 0 ? "mm_memalign failed." :
+			     "mm_malloc failed.");
+		return 0;
+	    }
+	    if (align != 0 && (uintptr_t)p % align != 0) {
+		sprintf(msg, "mm_memalign payload (%p) not aligned to %zu "
+			"bytes", p, align);
+		malloc_error(tracenum, i, msg);
 		return 0;
 	    }
+	    for (j = 0; calloced && j < size; j++) {
+		if (p[j] != 0) {
+		    malloc_error(tracenum, i, "mm_calloc did not zero the "
+				 "block");
+		    return 0;
+		}
+	    }
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
@@ -592,7 +1632,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = be->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
@@ -612,7 +1652,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -627,31 +1667,71 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         case FREE: /* mm_free */
 	    
-	    /* Remove region from list and call student's free function */
+	    /* A run of frees that starts with an odd id goes to one
+	       mm_free_batch */
+	    if (be->free_batch != NULL && index % 2 == 1 &&
+		(n = batch_run(trace, i)) > 1) {
+		for (j = 0; j < n; j++, i++) {
+		    batch[j] = trace->blocks[trace->ops[i].index];
+		    remove_range(ranges, batch[j]);
+		}
+		i--;
+		be->free_batch(batch, n);
+		break;
+	    }
+
+	    /* Remove region from list and call student's free function.
+	       Blocks with even ids are freed by size, to check the sized
+	       free too. */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    if (be->free_sized != NULL && index % 2 == 0)
+		be->free_sized(p, trace->block_sizes[index]);
+	    else
+		be->free(p);
 	    break;
 
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 
+	/* Fail the trace at the first op that the heap checker objects to */
+	if (check_failed) {
+	    check_failed = 0;
+	    malloc_error(tracenum, i, check_msg);
+	    return 0;
+	}
     }
 
     /* As far as we know, this is a valid malloc package */
+    free_leftovers(trace, trace->blocks);
     return 1;
 }
 
+/*
+ * batch_run - return the number of ops from op i on, up to BATCH_MAX,
+ *     that are frees, or allocs of the same size, like op i
+ */
+static unsigned batch_run(trace_t *trace, unsigned i)
+{
+    traceop_t *op = &trace->ops[i];
+    unsigned n = 1;
+
+    while (n < BATCH_MAX && i + n < trace->num_ops &&
+	   op[n].type == op->type &&
+	   (op->type == FREE || op[n].size == op->size))
+	n++;
+    return n;
+}
+
 /* 
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   peak size of the heap in bytes while running the student's malloc 
+ *   package on the trace. mem_sbrk() lets the allocator decrement the
+ *   brk pointer, so the final brk is not necessarily the high water mark.
  *   
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
@@ -670,7 +1750,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (be->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -680,7 +1760,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = be->malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -702,7 +1782,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = be->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -723,7 +1803,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    be->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -737,7 +1817,11 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    /* An allocator outside memlib's heap can't be measured */
+    free_leftovers(trace, trace->blocks);
+    if (be->heapsize == NULL)
+	return 0;
+    return ((double)max_total_size / (double)be->heapsize());
 }
 
 
@@ -753,7 +1837,7 @@ static void eval_mm_speed(void *ptr)
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
+    if (be->init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -763,7 +1847,7 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = be->malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -772,7 +1856,7 @@ static void eval_mm_speed(void *ptr)
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((newp = be->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
@@ -780,12 +1864,322 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            be->free(block);
             break;
 
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
+    free_leftovers(trace, trace->blocks);
+}
+
+/*
+ * eval_mm_threads - Replay the trace on 1, 2, ..., max_threads threads at
+ *    once against the shared mm package and print the throughput of each
+ *    thread and of all of them together.  With cross set, thread t
+ *    reallocs and frees the blocks that thread t + 1 allocated, so most
+ *    frees are of blocks that another thread allocated.
+ */
+static void eval_mm_threads(trace_t *trace, int max_threads, int cross)
+{
+    replay_t *replays;
+    pthread_t *tids;
+    pthread_barrier_t start;
+    double secs, first, last, t0, t1;
+    int n, t, failed, aborted;
+
+    if ((replays = (replay_t *)calloc(max_threads, sizeof(replay_t))) == NULL ||
+	(tids = (pthread_t *)calloc(max_threads, sizeof(pthread_t))) == NULL)
+	unix_error("calloc failed in eval_mm_threads");
+
+    printf("\nMultithreaded replay of %s (%s frees):\n", be->name,
+	   cross ? "cross-thread" : "same-thread");
+    printf("%7s%12s  %s\n", "threads", "Kops", "Kops per thread");
+    for (n = 1; n <= max_threads; n++) {
+	mem_reset_brk();
+	if (be->init() < 0)
+	    app_error("mm_init failed in eval_mm_threads");
+	pthread_barrier_init(&start, NULL, n);
+	aborted = 0;
+	for (t = 0; t < n; t++) {
+	    replays[t].trace = trace;
+	    if ((replays[t].blocks = 
+		 (char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
+		unix_error("calloc failed in eval_mm_threads");
+	    replays[t].start = &start;
+	    replays[t].failed = 0;
+	    replays[t].abort = &aborted;
+	}
+	for (t = 0; t < n; t++) {
+	    replays[t].victims = replays[cross ? (t + 1) % n : t].blocks;
+	    if (pthread_create(&tids[t], NULL, replay_thread, &replays[t]) != 0)
+		unix_error("pthread_create failed in eval_mm_threads");
+	}
+
+	/* Time all of the threads from the first start to the last finish */
+	failed = 0;
+	first = DBL_MAX;
+	last = 0;
+	for (t = 0; t < n; t++) {
+	    pthread_join(tids[t], NULL);
+	    failed |= replays[t].failed;
+	    t0 = replays[t].begin.tv_sec + replays[t].begin.tv_nsec / 1e9;
+	    t1 = replays[t].end.tv_sec + replays[t].end.tv_nsec / 1e9;
+	    first = (t0 < first) ? t0 : first;
+	    last = (t1 > last) ? t1 : last;
+	}
+	pthread_barrier_destroy(&start);
+	if (failed) {
+	    printf("%7d  ran out of memory\n", n);
+	} else {
+	    printf("%7d%12.0f ", n, n * trace->num_ops / 1e3 / (last - first));
+	    for (t = 0; t < n; t++) {
+		secs = (replays[t].end.tv_sec - replays[t].begin.tv_sec) +
+		    (replays[t].end.tv_nsec - replays[t].begin.tv_nsec) / 1e9;
+		printf(" %.0f", trace->num_ops / 1e3 / secs);
+	    }
+	    printf("\n");
+	}
+	for (t = 0; t < n; t++) {
+	    if (!failed)
+		free_leftovers(trace, replays[t].blocks);
+	    free(replays[t].blocks);
+	}
+	if (failed)
+	    break;
+    }
+    free(replays);
+    free(tids);
+}
+
+/*
+ * replay_thread - Replay a trace as one thread of eval_mm_threads.  A
+ *    block is handed from the thread that allocated it to the one that
+ *    frees it through its slot in the allocating thread's blocks array,
+ *    so each thread waits for a slot to be filled before it reallocs or
+ *    frees the block, and for it to be emptied before it reuses the id.
+ *    A thread that runs out of memory sets the shared abort flag, and
+ *    every thread stops at its next wait or request once it is set, since
+ *    the slots that the failed thread would have filled stay empty.
+ */
+static void *replay_thread(void *arg)
+{
+    replay_t *r = (replay_t *)arg;
+    trace_t *trace = r->trace;
+    char *p, **slot;
+    unsigned i, index, size;
+
+    pthread_barrier_wait(r->start);
+    clock_gettime(CLOCK_MONOTONIC, &r->begin);
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+	switch (trace->ops[i].type) {
+
+	case ALLOC: /* mm_malloc */
+	    slot = &r->blocks[index];
+	    while ((p = __atomic_load_n(slot, __ATOMIC_ACQUIRE)) != NULL &&
+		   !__atomic_load_n(r->abort, __ATOMIC_ACQUIRE))
+		sched_yield();
+	    if (p != NULL)
+		break;
+	    if ((p = be->malloc(size)) == NULL) {
+		r->failed = 1;
+		__atomic_store_n(r->abort, 1, __ATOMIC_RELEASE);
+		break;
+	    }
+	    __atomic_store_n(slot, p, __ATOMIC_RELEASE);
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    slot = &r->victims[index];
+	    while ((p = __atomic_load_n(slot, __ATOMIC_ACQUIRE)) == NULL &&
+		   !__atomic_load_n(r->abort, __ATOMIC_ACQUIRE))
+		sched_yield();
+	    if (p == NULL)
+		break;
+	    if ((p = be->realloc(p, size)) == NULL) {
+		r->failed = 1;
+		__atomic_store_n(r->abort, 1, __ATOMIC_RELEASE);
+		break;
+	    }
+	    __atomic_store_n(slot, p, __ATOMIC_RELEASE);
+	    break;
+
+	case FREE: /* mm_free */
+	    slot = &r->victims[index];
+	    while ((p = __atomic_load_n(slot, __ATOMIC_ACQUIRE)) == NULL &&
+		   !__atomic_load_n(r->abort, __ATOMIC_ACQUIRE))
+		sched_yield();
+	    if (p == NULL)
+		break;
+	    be->free(p);
+	    __atomic_store_n(slot, NULL, __ATOMIC_RELEASE);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in replay_thread");
+	}
+	if (__atomic_load_n(r->abort, __ATOMIC_ACQUIRE))
+	    break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &r->end);
+    return NULL;
+}
+
+/*
+ * eval_mm_latency - Replay the trace once, timing every request with the
+ *    cycle counter, and print percentiles of the latency of each type of
+ *    request.  The cost of reading the counter is measured first and
+ *    taken off every sample.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    static const char *names[] = {"malloc", "free", "realloc"};
+    static const double qs[] = {0.5, 0.9, 0.99, 0.999};
+    lathist_t *hists;
+    uint64_t ovhd, t0, t1;
+    unsigned i, j, index, size;
+    char *p;
+
+    if ((hists = (lathist_t *)calloc(3, sizeof(lathist_t))) == NULL)
+	unix_error("calloc failed in eval_mm_latency");
+    ovhd = lat_ovhd();
+
+    mem_reset_brk();
+    if (be->init() < 0)
+	app_error("mm_init failed in eval_mm_latency");
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+	switch (trace->ops[i].type) {
+
+	case ALLOC: /* mm_malloc */
+	    t0 = read_counter();
+	    p = be->malloc(size);
+	    t1 = read_counter();
+	    if (p == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+	    trace->blocks[index] = p;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    t0 = read_counter();
+	    p = be->realloc(trace->blocks[index], size);
+	    t1 = read_counter();
+	    if (p == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+	    trace->blocks[index] = p;
+	    break;
+
+	case FREE: /* mm_free */
+	    p = trace->blocks[index];
+	    t0 = read_counter();
+	    be->free(p);
+	    t1 = read_counter();
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+	}
+	lat_add(&hists[trace->ops[i].type],
+		(t1 - t0 > ovhd) ? t1 - t0 - ovhd : 0);
+    }
+
+    free_leftovers(trace, trace->blocks);
+
+    /* Percentiles are the upper edge of their bucket */
+    printf("\nLatency of %s in cycles (%llu cycles of timing overhead "
+	   "removed):\n", be->name, (unsigned long long)ovhd);
+    printf("%-8s%10s%9s%9s%9s%9s%11s\n",
+	   "op", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (i = 0; i < 3; i++) {
+	if (hists[i].count == 0)
+	    continue;
+	printf("%-8s%10llu", names[i], (unsigned long long)hists[i].count);
+	stats->lat[i][0] = hists[i].count;
+	for (j = 0; j < sizeof(qs) / sizeof(qs[0]); j++) {
+	    stats->lat[i][j + 1] = lat_percentile(&hists[i], qs[j]);
+	    printf("%9llu", (unsigned long long)stats->lat[i][j + 1]);
+	}
+	stats->lat[i][LAT_STATS - 1] = hists[i].max;
+	printf("%11llu\n", (unsigned long long)hists[i].max);
+    }
+    stats->has_lat = 1;
+    free(hists);
+}
+
+/*
+ * read_counter - Return the cycle counter as one 64-bit number
+ */
+static uint64_t read_counter(void)
+{
+    unsigned hi, lo;
+
+    access_counter(&hi, &lo);
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/*
+ * lat_ovhd - Measure the cycles that timing an empty request takes.  Like
+ *    ovhd(), this times nothing, but it keeps the fastest of LAT_TRIES
+ *    tries so that an interrupt doesn't inflate the estimate.
+ */
+static uint64_t lat_ovhd(void)
+{
+    uint64_t t0, t1, best = UINT64_MAX;
+    int i;
+
+    for (i = 0; i < LAT_TRIES; i++) {
+	t0 = read_counter();
+	t1 = read_counter();
+	if (t1 - t0 < best)
+	    best = t1 - t0;
+    }
+    return best;
+}
+
+/*
+ * lat_add - Add a sample of the given number of cycles to a histogram
+ */
+static void lat_add(lathist_t *hist, uint64_t cycles)
+{
+    int lg, bucket;
+
+    if (cycles < LAT_SUBS) {
+	bucket = cycles;
+    } else {
+	lg = 63 - __builtin_clzll(cycles);
+	bucket = (lg - LAT_SUB_BITS + 1) * LAT_SUBS +
+	    (int)((cycles >> (lg - LAT_SUB_BITS)) & (LAT_SUBS - 1));
+    }
+    hist->buckets[bucket]++;
+    hist->count++;
+    if (cycles > hist->max)
+	hist->max = cycles;
+}
+
+/*
+ * lat_percentile - Return the upper edge of the histogram bucket that
+ *    holds the q-th quantile of the samples, or the max if that is less
+ */
+static uint64_t lat_percentile(lathist_t *hist, double q)
+{
+    uint64_t rank = (uint64_t)(q * hist->count), seen = 0, edge;
+    int bucket, lg;
+
+    for (bucket = 0; bucket < LAT_BUCKETS; bucket++) {
+	if ((seen += hist->buckets[bucket]) > rank)
+	    break;
+    }
+    if (bucket < LAT_SUBS) {
+	edge = bucket;
+    } else {
+	lg = bucket / LAT_SUBS + LAT_SUB_BITS - 1;
+	edge = ((uint64_t)(LAT_SUBS + bucket % LAT_SUBS + 1) <<
+		(lg - LAT_SUB_BITS)) - 1;
+    }
+    return (edge < hist->max) ? edge : hist->max;
 }
 
 /*************************************
@@ -852,6 +2246,550 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printcounts - Print the events that -p counted in one run of a trace,
+ *     in total and per op, and the instructions per cycle
+ */
+static void printcounts(stats_t *stats)
+{
+    fcount_t *c = &stats->counts;
+    int e;
+
+    printf("\nEvents of %s in one run:\n", be->name);
+    printf("%-18s%16s%12s\n", "event", "total", "per op");
+    for (e = 0; e < FC_EVENTS; e++)
+	if (c->valid & (1u << e))
+	    printf("%-18s%16.0f%12.2f\n", fcount_name(e), c->counts[e],
+		   c->counts[e] / stats->ops);
+    if ((c->valid & (1u << FC_CYCLES)) && (c->valid & (1u << FC_INSTRUCTIONS))
+	&& c->counts[FC_CYCLES] > 0)
+	printf("%-18s%16.2f\n", "IPC",
+	       c->counts[FC_INSTRUCTIONS] / c->counts[FC_CYCLES]);
+}
+
+/*
+ * event_key - Turn an event name into a lowercase identifier for the
+ *     JSON and CSV output, such as "task_clock_ns"
+ */
+static char *event_key(int event, char *buf, size_t len)
+{
+    const char *name = fcount_name(event);
+    size_t n = 0;
+
+    for (; *name != '\0' && n + 1 < len; name++) {
+	if ((*name >= 'a' && *name <= 'z') || (*name >= '0' && *name <= '9'))
+	    buf[n++] = *name;
+	else if (*name >= 'A' && *name <= 'Z')
+	    buf[n++] = *name - 'A' + 'a';
+	else if (n > 0 && buf[n - 1] != '_')
+	    buf[n++] = '_';
+    }
+    while (n > 0 && buf[n - 1] == '_')
+	n--;
+    buf[n] = '\0';
+    return buf;
+}
+
+/* Names of the request types and of the latency stats, for -o */
+static const char *lat_ops[] = {"malloc", "free", "realloc"};
+static const char *lat_keys[LAT_STATS] = {
+    "count", "p50", "p90", "p99", "p999", "max"
+};
+
+/*
+ * write_results - Write the results of every backend on every trace to
+ *     the file path, as CSV if its name ends in ".csv" and JSON otherwise
+ */
+static void write_results(char *path, int n, int num_used, backend_t **used,
+			  char **tracefiles, stats_t *stats)
+{
+    size_t len = strlen(path);
+    FILE *file;
+
+    if ((file = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in write_results", path);
+	unix_error(msg);
+    }
+    if (len > 4 && strcmp(path + len - 4, ".csv") == 0)
+	write_csv(file, n, num_used, used, tracefiles, stats);
+    else
+	write_json(file, n, num_used, used, tracefiles, stats);
+    if (fclose(file) != 0) {
+	sprintf(msg, "Could not write %s in write_results", path);
+	unix_error(msg);
+    }
+}
+
+/*
+ * write_json - Write the environment and one object per backend and trace
+ */
+static void write_json(FILE *file, int n, int num_used, backend_t **used,
+		       char **tracefiles, stats_t *stats)
+{
+    char **meta = get_meta(), key[64];
+    stats_t *st;
+    int i, b, j, e, sep;
+
+    fprintf(file, "{\n  \"meta\": {");
+    for (j = 0; meta[j] != NULL; j += 2) {
+	fprintf(file, "%s\n    ", (j == 0) ? "" : ",");
+	json_string(file, meta[j]);
+	fprintf(file, ": ");
+	json_string(file, meta[j + 1]);
+    }
+    fprintf(file, "\n  },\n  \"results\": [");
+    for (b = 0; b < num_used; b++) {
+	for (i = 0; i < n; i++) {
+	    st = &stats[b * n + i];
+	    fprintf(file, "%s\n    {\"backend\": ", (b + i == 0) ? "" : ",");
+	    json_string(file, used[b]->name);
+	    fprintf(file, ", \"trace\": ");
+	    json_string(file, tracefiles[i]);
+	    fprintf(file, ", \"valid\": %s, \"ops\": %.0f",
+		    st->valid ? "true" : "false", st->ops);
+	    if (!st->valid) {
+		fprintf(file, "}");
+		continue;
+	    }
+	    fprintf(file, ",\n     \"secs\": %.9f, \"kops\": %.3f", st->secs,
+		    st->ops / 1e3 / st->secs);
+	    if (used[b]->heapsize != NULL)
+		fprintf(file, ", \"util\": %.6f", st->util);
+	    fprintf(file, ",\n     \"kops_samples\": [");
+	    for (j = 0; j < st->num_samples; j++)
+		fprintf(file, "%s%.3f", (j == 0) ? "" : ", ",
+			st->ops / 1e3 / st->samples[j]);
+	    fprintf(file, "]");
+	    if (st->has_lat) {
+		fprintf(file, ",\n     \"latency\": {");
+		for (j = 0; j < 3; j++) {
+		    fprintf(file, "%s\"%s\": {", (j == 0) ? "" : ", ",
+			    lat_ops[j]);
+		    for (e = 0; e < LAT_STATS; e++)
+			fprintf(file, "%s\"%s\": %.0f", (e == 0) ? "" : ", ",
+				lat_keys[e], st->lat[j][e]);
+		    fprintf(file, "}");
+		}
+		fprintf(file, "}");
+	    }
+	    if (st->counts.valid) {
+		fprintf(file, ",\n     \"counters\": {");
+		for (e = 0, sep = 0; e < FC_EVENTS; e++) {
+		    if (!(st->counts.valid & (1u << e)))
+			continue;
+		    fprintf(file, "%s\"%s\": %.0f", sep++ ? ", " : "",
+			    event_key(e, key, sizeof(key)), st->counts.counts[e]);
+		}
+		fprintf(file, "}");
+	    }
+	    fprintf(file, "}");
+	}
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+
+/*
+ * write_csv - Write the environment as "#" comment lines, then a header
+ *     and one row per backend and trace.  Fields that weren't measured
+ *     are empty, and kops_samples holds the -k runs separated by ";".
+ */
+static void write_csv(FILE *file, int n, int num_used, backend_t **used,
+		      char **tracefiles, stats_t *stats)
+{
+    char **meta = get_meta(), key[64];
+    stats_t *st;
+    int i, b, j, e;
+
+    for (j = 0; meta[j] != NULL; j += 2)
+	fprintf(file, "# %s: %s\n", meta[j], meta[j + 1]);
+    fprintf(file, "backend,trace,valid,ops,secs,kops,util,kops_samples");
+    for (j = 0; j < 3; j++)
+	for (e = 0; e < LAT_STATS; e++)
+	    fprintf(file, ",%s_%s", lat_ops[j], lat_keys[e]);
+    for (e = 0; e < FC_EVENTS; e++)
+	fprintf(file, ",%s", event_key(e, key, sizeof(key)));
+    fprintf(file, "\n");
+
+    for (b = 0; b < num_used; b++) {
+	for (i = 0; i < n; i++) {
+	    st = &stats[b * n + i];
+	    json_string(file, used[b]->name);
+	    fprintf(file, ",");
+	    json_string(file, tracefiles[i]);
+	    fprintf(file, ",%d,%.0f", st->valid, st->ops);
+	    if (st->valid) {
+		fprintf(file, ",%.9f,%.3f,", st->secs, st->ops / 1e3 / st->secs);
+		if (used[b]->heapsize != NULL)
+		    fprintf(file, "%.6f", st->util);
+		fprintf(file, ",");
+		for (j = 0; j < st->num_samples; j++)
+		    fprintf(file, "%s%.3f", (j == 0) ? "" : ";",
+			    st->ops / 1e3 / st->samples[j]);
+	    } else {
+		fprintf(file, ",,,,");
+	    }
+	    for (j = 0; j < 3; j++)
+		for (e = 0; e < LAT_STATS; e++)
+		    if (st->valid && st->has_lat)
+			fprintf(file, ",%.0f", st->lat[j][e]);
+		    else
+			fprintf(file, ",");
+	    for (e = 0; e < FC_EVENTS; e++)
+		if (st->valid && (st->counts.valid & (1u << e)))
+		    fprintf(file, ",%.0f", st->counts.counts[e]);
+		else
+		    fprintf(file, ",");
+	    fprintf(file, "\n");
+	}
+    }
+}
+
+/*
+ * json_string - Write a string in double quotes, escaping what JSON and
+ *     CSV require to be escaped.  (The two agree on the quotes themselves
+ *     only for strings without quotes, which trace names don't have.)
+ */
+static void json_string(FILE *file, const char *str)
+{
+    fputc('"', file);
+    for (; *str != '\0'; str++) {
+	if (*str == '"' || *str == '\\')
+	    fprintf(file, "\\%c", *str);
+	else if ((unsigned char)*str < 0x20)
+	    fprintf(file, "\\u%04x", *str);
+	else
+	    fputc(*str, file);
+    }
+    fputc('"', file);
+}
+
+/*
+ * get_meta - Return the environment of the run as a NULL-terminated
+ *     array of names and values
+ */
+static char **get_meta(void)
+{
+    static char date[64], host[256], kernel[256], cpu[256], cpus[16];
+    static char *meta[32];
+    struct utsname uts;
+    char line[MAXLINE], *p;
+    time_t now = time(NULL);
+    FILE *file;
+    int n = 0;
+
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    strcpy(host, "unknown");
+    strcpy(kernel, "unknown");
+    if (uname(&uts) == 0) {
+	snprintf(host, sizeof(host), "%s", uts.nodename);
+	snprintf(kernel, sizeof(kernel), "%s %s %s", uts.sysname,
+		 uts.release, uts.machine);
+    }
+    strcpy(cpu, "unknown");
+    if ((file = fopen("/proc/cpuinfo", "r")) != NULL) {
+	while (fgets(line, sizeof(line), file) != NULL) {
+	    if (strncmp(line, "model name", 10) == 0 &&
+		(p = strchr(line, ':')) != NULL) {
+		for (p++; *p == ' '; p++)
+		    ;
+		p[strcspn(p, "\n")] = '\0';
+		snprintf(cpu, sizeof(cpu), "%s", p);
+		break;
+	    }
+	}
+	fclose(file);
+    }
+    snprintf(cpus, sizeof(cpus), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+
+    meta[n++] = "date";       meta[n++] = date;
+    meta[n++] = "host";       meta[n++] = host;
+    meta[n++] = "kernel";     meta[n++] = kernel;
+    meta[n++] = "cpu";        meta[n++] = cpu;
+    meta[n++] = "cpus";       meta[n++] = cpus;
+#ifdef __clang__
+    meta[n++] = "compiler";   meta[n++] = "clang " __clang_version__;
+#else
+    meta[n++] = "compiler";   meta[n++] = "gcc " __VERSION__;
+#endif
+#ifdef BUILD_CFLAGS
+    meta[n++] = "cflags";     meta[n++] = BUILD_CFLAGS;
+#endif
+#if USE_FCYC
+    meta[n++] = "timer";      meta[n++] = "cycle counter";
+#elif USE_ITIMER
+    meta[n++] = "timer";      meta[n++] = "interval timer";
+#else
+    meta[n++] = "timer";      meta[n++] = "gettimeofday";
+#endif
+    meta[n++] = "mm_threads"; meta[n++] = MM_THREADS ? "1" : "0";
+    meta[n++] = "mm_quicklists"; meta[n++] = MM_QUICKLISTS ? "1" : "0";
+    meta[n++] = "mm_stats";   meta[n++] = MM_STATS ? "1" : "0";
+    meta[n++] = "mm_profile"; meta[n++] = MM_PROFILE ? "1" : "0";
+    meta[n++] = "mm_hugepages"; meta[n++] = MM_HUGEPAGES ? "1" : "0";
+#ifdef MM_BINS
+    meta[n++] = "mm_bins";    meta[n++] = MM_BINS;
+#endif
+    meta[n] = NULL;
+    return meta;
+}
+
+/*
+ * csv_fields - Split a CSV line into at most max fields in place, undoing
+ *     the quoting that write_csv() does.  Return the number of fields.
+ */
+static int csv_fields(char *line, char **fields, int max)
+{
+    char *in = line, *out = line;
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    while (n < max) {
+	fields[n++] = out;
+	if (*in == '"') {
+	    for (in++; *in != '\0' && *in != '"'; in++) {
+		if (*in == '\\' && in[1] != '\0')
+		    in++;
+		*out++ = *in;
+	    }
+	    if (*in == '"')
+		in++;
+	}
+	while (*in != '\0' && *in != ',')
+	    *out++ = *in++;
+	if (*in == '\0') {
+	    *out = '\0';
+	    break;
+	}
+	in++;
+	*out++ = '\0';
+    }
+    return n;
+}
+
+/*
+ * compare_results - Compare the throughput and utilization of every
+ *     backend on every trace with the same backend and trace in a CSV
+ *     file that -o wrote, and print the changes.  Return the number of
+ *     regressions: throughput that dropped by more than THRU_TOLERANCE
+ *     with a Welch's t-test over the -k runs significant at the 95% level,
+ *     or utilization that dropped by more than UTIL_TOLERANCE.
+ */
+static int compare_results(char *path, int n, int num_used, backend_t **used,
+			   char **tracefiles, stats_t *stats)
+{
+    char line[16 * MAXLINE], *fields[128], *p;
+    int col_backend = -1, col_trace = -1, col_util = -1, col_samples = -1;
+    int nf, i, b, j, found, regressions = 0;
+    double x, base_mean, base_var, base_n, now_mean, now_var, now_n;
+    double se, t, df, base_util;
+    const char *verdict;
+    stats_t *st;
+    FILE *file;
+
+    if ((file = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in compare_results", path);
+	unix_error(msg);
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+	if (line[0] == '#')
+	    continue;
+	nf = csv_fields(line, fields, 128);
+	if (col_backend < 0) {
+	    for (j = 0; j < nf; j++) {
+		if (strcmp(fields[j], "backend") == 0)
+		    col_backend = j;
+		else if (strcmp(fields[j], "trace") == 0)
+		    col_trace = j;
+		else if (strcmp(fields[j], "util") == 0)
+		    col_util = j;
+		else if (strcmp(fields[j], "kops_samples") == 0)
+		    col_samples = j;
+	    }
+	    if (col_backend < 0 || col_trace < 0 || col_util < 0 ||
+		col_samples < 0) {
+		sprintf(msg, "%s is not a CSV file that -o wrote", path);
+		app_error(msg);
+	    }
+	    printf("Comparison with %s:\n", path);
+	    printf("%-14s%-24s%12s%12s%8s%8s%8s  %s\n", "backend", "trace",
+		   "base Kops", "Kops", "change", "base", "util", "verdict");
+	    continue;
+	}
+	if (nf <= col_samples || *fields[col_samples] == '\0')
+	    continue;
+
+	/* Find the same backend and trace in this run */
+	for (b = 0, found = 0; b < num_used && !found; b++)
+	    for (i = 0; i < n && !found; i++)
+		found = strcmp(used[b]->name, fields[col_backend]) == 0 &&
+		    strcmp(tracefiles[i], fields[col_trace]) == 0;
+	if (!found)
+	    continue;
+	st = &stats[(b - 1) * n + (i - 1)];
+	if (!st->valid)
+	    continue;
+
+	/* The mean and variance of each side's throughput */
+	base_mean = base_var = base_n = 0;
+	for (p = strtok(fields[col_samples], ";"); p != NULL;
+	     p = strtok(NULL, ";")) {
+	    x = atof(p);
+	    base_n++;
+	    base_var += (x - base_mean) * (x - base_mean) * (base_n - 1) /
+		base_n;
+	    base_mean += (x - base_mean) / base_n;
+	}
+	now_mean = now_var = now_n = 0;
+	for (j = 0; j < st->num_samples; j++) {
+	    x = st->ops / 1e3 / st->samples[j];
+	    now_n++;
+	    now_var += (x - now_mean) * (x - now_mean) * (now_n - 1) / now_n;
+	    now_mean += (x - now_mean) / now_n;
+	}
+
+	verdict = "ok";
+	if (base_n < 2 || now_n < 2) {
+	    verdict = "too few runs to test";
+	} else if (now_mean < base_mean * (1 - THRU_TOLERANCE)) {
+	    base_var /= base_n - 1;
+	    now_var /= now_n - 1;
+	    se = sqrt(base_var / base_n + now_var / now_n);
+	    t = (se > 0) ? (base_mean - now_mean) / se : DBL_MAX;
+	    df = (se > 0) ? pow(se, 4) /
+		(pow(base_var / base_n, 2) / (base_n - 1) +
+		 pow(now_var / now_n, 2) / (now_n - 1)) : 1;
+	    if (t > t_crit(df)) {
+		verdict = "REGRESSION (throughput)";
+		regressions++;
+	    }
+	}
+	base_util = atof(fields[col_util]);
+	if (used[b - 1]->heapsize != NULL && *fields[col_util] != '\0' &&
+	    st->util < base_util - UTIL_TOLERANCE) {
+	    verdict = (strcmp(verdict, "ok") == 0 ||
+		       verdict[0] == 't') ? "REGRESSION (util)" :
+		"REGRESSION (throughput, util)";
+	    regressions++;
+	}
+	printf("%-14s%-24s%12.0f%12.0f%+7.1f%%", used[b - 1]->name,
+	       tracefiles[i - 1], base_mean, now_mean,
+	       (now_mean / base_mean - 1) * 100);
+	if (used[b - 1]->heapsize != NULL && *fields[col_util] != '\0')
+	    printf("%7.1f%%%7.1f%%", base_util * 100, st->util * 100);
+	else
+	    printf("%8s%8s", "-", "-");
+	printf("  %s\n", verdict);
+    }
+    fclose(file);
+    if (col_backend < 0) {
+	sprintf(msg, "%s is not a CSV file that -o wrote", path);
+	app_error(msg);
+    }
+    printf("%d regression%s\n\n", regressions, regressions == 1 ? "" : "s");
+    return regressions;
+}
+
+/*
+ * t_crit - Return the two-sided 95% critical value of Student's t
+ *     distribution with df degrees of freedom
+ */
+static double t_crit(double df)
+{
+    static const double table[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+	2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+	2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+	2.048, 2.045, 2.042
+    };
+    int i = (int)df;  /* rounding down is conservative */
+
+    if (i < 1)
+	return table[0];
+    if (i <= 30)
+	return table[i - 1];
+    return 1.960 + 2.4 / df;
+}
+
+/*
+ * printcompare - Print each backend's utilization and throughput on each
+ *     trace, side by side
+ */
+static void printcompare(int n, int num_used, backend_t **used,
+			 stats_t *stats)
+{
+    stats_t *st;
+    double secs, ops, util;
+    int i, b;
+
+    printf("Comparison (util, Kops):\n%5s", "trace");
+    for (b = 0; b < num_used; b++)
+	printf("%19s", used[b]->name);
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	printf("%5d", i);
+	for (b = 0; b < num_used; b++) {
+	    st = &stats[b * n + i];
+	    if (!st->valid)
+		printf("%19s", "-");
+	    else if (used[b]->heapsize == NULL)
+		printf("%9s%10.0f", "-", (st->ops / 1e3) / st->secs);
+	    else
+		printf("%8.0f%%%10.0f", st->util * 100.0,
+		       (st->ops / 1e3) / st->secs);
+	}
+	printf("\n");
+    }
+    printf("%5s", "Total");
+    for (b = 0; b < num_used; b++) {
+	secs = ops = util = 0;
+	for (i = 0; i < n; i++) {
+	    st = &stats[b * n + i];
+	    secs += st->secs;
+	    ops += st->ops;
+	    util += st->util;
+	}
+	if (used[b]->heapsize == NULL)
+	    printf("%9s%10.0f", "-", (ops / 1e3) / secs);
+	else
+	    printf("%8.0f%%%10.0f", (util / n) * 100.0, (ops / 1e3) / secs);
+    }
+    printf("\n");
+}
+
+/*
+ * select_backends - Look up the comma-separated backend names, or "all",
+ *     and return how many there are, or 0 if one is unknown
+ */
+static int select_backends(char *names, backend_t **used)
+{
+    char *name;
+    int n = 0, b;
+
+    if (strcmp(names, "all") == 0) {
+	for (b = 0; b < NUM_BACKENDS; b++)
+	    used[b] = &backends[b];
+	return NUM_BACKENDS;
+    }
+    for (name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+	for (b = 0; b < NUM_BACKENDS; b++)
+	    if (strcmp(name, backends[b].name) == 0)
+		break;
+	if (b == NUM_BACKENDS || n == NUM_BACKENDS)
+	    return 0;
+	used[n++] = &backends[b];
+    }
+    return n;
+}
+
+/*
+ * libc_init - The C library's malloc needs no initialization, and its
+ *     heap can't be reset
+ */
+static int libc_init(void)
+{
+    return 0;
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -879,18 +2817,46 @@ void malloc_error(int tracenum, int opnum, char *msg)
     printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
+/*
+ * heap_check_failed - Remember the first failure that the mm package's
+ *     heap checker reports during an op, for eval_mm_valid to report
+ */
+static void heap_check_failed(const char *msg, void *bp)
+{
+    if (!check_failed)
+	snprintf(check_msg, sizeof(check_msg), "heap check failed at %p: %s",
+		 bp, msg);
+    check_failed = 1;
+}
+
 /* 
  * usage - Explain the command line arguments
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-aghvV] [-f <file>] [-t <dir>]\n");
+    int i;
+
+    fprintf(stderr, "Usage: mdriver [-aghlvVx] [-b <file>] [-B <file>] [-c <n>] [-f <file>] [-k <n>] [-m <names>] [-o <file>] [-p <groups>] [-r <file>] [-t <dir>] [-T <n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
-    fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-b <file>  Write the -f trace to <file> in binary and exit.\n");
+    fprintf(stderr, "\t-B <file>  Write free list bins tuned to the traces to <file> and exit.\n");
+    fprintf(stderr, "\t-c <n>     Check the heap every <n> ops while checking correctness.\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as a trace file (text, binary or log).\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-k <n>     Time each trace <n> times, for -r.\n");
+    fprintf(stderr, "\t-l         Print latency percentiles of each request type.\n");
+    fprintf(stderr, "\t-m <names> Evaluate these comma-separated allocators, or \"all\":\n\t           ");
+    for (i = 0; i < NUM_BACKENDS; i++)
+	fprintf(stderr, " %s", backends[i].name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "\t-o <file>  Write the results to <file> as JSON, or CSV if it ends in .csv.\n");
+    fprintf(stderr, "\t-p <groups> Count these comma-separated event groups, or \"all\":\n\t           ipc cache tlb branch sw\n");
+    fprintf(stderr, "\t-r <file>  Flag regressions against a CSV file from -o, exiting with 2.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Also replay each trace on 1..<n> threads at once.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-x         Make the threads of -T free each other's blocks.\n");
 }
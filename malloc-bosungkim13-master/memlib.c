@@ -2,7 +2,36 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The heap is a MAX_HEAP-byte range of virtual memory that is
+ *            reserved up front with no access rights.  Pages are committed
+ *            as mem_sbrk() grows the heap and decommitted when it shrinks,
+ *            and mem_release() lets the allocator hand the pages of a free
+ *            block back to the OS while the heap keeps its size.
+ *
+ *            On a machine with several NUMA nodes there is one such heap,
+ *            an arena, per node, up to MM_ARENAS of them.  Each arena's
+ *            pages prefer its node, and mem_home() tells a thread which
+ *            arena is local to the node it runs on.  mem_sbrk() and
+ *            mem_heap_lo()/mem_heap_hi() are arena 0.  Setting MM_NODES
+ *            in the environment simulates that many nodes, with threads
+ *            assigned to them in turn, to exercise the arenas on a
+ *            machine with a single node.
+ *
+ *            Large blocks can also be mapped individually with mem_map().
+ *            Each mapping starts with a small record that links it into a
+ *            list of live mappings, so that mem_is_heap() can recognize
+ *            them and the peak heap size can account for them.
+ *
+ *            With MM_HUGEPAGES, each arena is reserved on a huge page
+ *            boundary and advised with MADV_HUGEPAGE, and its pages are
+ *            committed, decommitted and released in whole huge pages, so
+ *            the kernel can back the heap with huge pages and never has
+ *            to split one.  Mappings of at least a huge page are aligned
+ *            and advised the same way.
  */
+#define _GNU_SOURCE  /* for mremap() and getcpu() */
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,28 +39,106 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* Granularity, in bytes, at which heap pages are committed, and at which
+   they are decommitted and released */
+#if MM_HUGEPAGES
+#define MEM_COMMIT_CHUNK HUGE_PAGE_SIZE
+#define MEM_RELEASE_UNIT HUGE_PAGE_SIZE
+#else
+#define MEM_COMMIT_CHUNK (64 * 1024)
+#define MEM_RELEASE_UNIT mem_pagesize()
+#endif
+
+/* The record at the start of every mapping made by mem_map() */
+typedef struct map_t {
+    struct map_t *next;  /* next live mapping */
+    struct map_t *prev;  /* previous live mapping */
+    size_t len;          /* length of the mapping, including this record */
+    size_t pad;          /* keeps the area after the record 16-byte aligned */
+} map_t;
+
+/* The reserved range and the brk of one arena */
+typedef struct {
+    char *start_brk;         /* points to first byte of heap */
+    char *brk;               /* points to last byte of heap */
+    char *max_addr;          /* largest legal heap address */
+    char *commit_brk;        /* end of the committed (accessible) pages */
+    char *dirty_brk;         /* heap bytes from here up are known to be zero */
+#if MM_THREADS
+    pthread_mutex_t lock;    /* guards brk, commit_brk and dirty_brk */
+#endif
+} arena_t;
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static arena_t mem_arena[MM_ARENAS];
+static int mem_num_arenas;   /* arenas in use, one per node up to MM_ARENAS */
+static int mem_fake_nodes;   /* nodes simulated by MM_NODES, or 0 */
+static unsigned mem_next_node; /* the next thread's simulated node */
+static size_t mem_peak;      /* largest heap size since the last reset */
+static map_t mem_maps = {&mem_maps, &mem_maps, 0, 0}; /* live mappings */
+static size_t mem_mapped;    /* bytes in live mappings */
+#if MM_THREADS
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER; /* guards mem_maps */
+#endif
+
+static int mem_nodes(void);
+static void mem_bind(arena_t *a, int node);
+static void *mem_reserve(size_t len, int prot, int flags);
+static char *page_down(char *p);
+static char *page_up(char *p);
+static char *unit_down(char *p);
+static char *unit_up(char *p);
+static void mem_decommit(char *lo, char *hi);
+static void mem_update_peak(void);
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
-	exit(1);
+    char *env = getenv("MM_NODES");
+    arena_t *a;
+    int i, nodes;
+
+    if (env != NULL && atoi(env) > 0) {
+	mem_fake_nodes = atoi(env);
+	nodes = mem_fake_nodes;
+    } else {
+	nodes = mem_nodes();
     }
+    mem_num_arenas = (nodes < MM_ARENAS) ? nodes : MM_ARENAS;
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    for (i = 0; i < mem_num_arenas; i++) {
+	a = &mem_arena[i];
+
+	/* reserve the address space we will use to model the available VM */
+	a->start_brk = mem_reserve(MAX_HEAP, PROT_NONE,
+				   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE);
+	if (a->start_brk == MAP_FAILED) {
+	    fprintf(stderr, "mem_init_vm: mmap error\n");
+	    exit(1);
+	}
+	if (mem_num_arenas > 1 && mem_fake_nodes == 0)
+	    mem_bind(a, i);
+
+	a->max_addr = a->start_brk + MAX_HEAP;  /* max legal heap address */
+	a->brk = a->start_brk;                  /* heap is empty initially */
+	a->commit_brk = a->start_brk;           /* nothing is committed yet */
+	a->dirty_brk = a->start_brk;            /* nothing is written yet */
+#if MM_THREADS
+	pthread_mutex_init(&a->lock, NULL);
+#endif
+    }
+    mem_peak = 0;
 }
 
 /* 
@@ -39,57 +146,379 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    int i;
+
+    for (i = 0; i < mem_num_arenas; i++)
+	munmap(mem_arena[i].start_brk, MAX_HEAP);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointers to make empty arenas.
+ *    Committed pages stay committed, so repeated runs of a trace measure
+ *    the allocator rather than page faults.
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    map_t *m;
+    int i;
+
+#if MM_THREADS
+    pthread_mutex_lock(&mem_lock);
+#endif
+    /* Mappings belong to the heap that is being discarded */
+    while ((m = mem_maps.next) != &mem_maps) {
+	mem_maps.next = m->next;
+	munmap(m, m->len);
+    }
+    mem_maps.prev = &mem_maps;
+    mem_mapped = 0;
+#if MM_THREADS
+    pthread_mutex_unlock(&mem_lock);
+#endif
+    for (i = 0; i < mem_num_arenas; i++) {
+#if MM_THREADS
+	pthread_mutex_lock(&mem_arena[i].lock);
+#endif
+	mem_arena[i].brk = mem_arena[i].start_brk;
+#if MM_THREADS
+	pthread_mutex_unlock(&mem_arena[i].lock);
+#endif
+    }
+    mem_peak = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap and decommits the pages above the
+ *    new brk. Safe to call from several threads at once when MM_THREADS
+ *    is set.
  */
 void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    return mem_arena_sbrk(0, incr);
+}
+
+/*
+ * mem_arena_sbrk - mem_sbrk() for the heap of an arena.  Only the
+ *    arena's own lock is taken, so arenas grow independently.
+ */
+void *mem_arena_sbrk(int arena, intptr_t incr)
+{
+    arena_t *a = &mem_arena[arena];
+    char *old_brk;
+    char *commit;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+#if MM_THREADS
+    pthread_mutex_lock(&a->lock);
+#endif
+    old_brk = a->brk;
+    if ((incr < 0 && a->brk + incr < a->start_brk) ||
+	(incr > 0 && a->brk + incr > a->max_addr)) {
+#if MM_THREADS
+	pthread_mutex_unlock(&a->lock);
+#endif
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+    /* Other threads read the brk without the lock, in mem_arena_of() */
+    __atomic_store_n(&a->brk, old_brk + incr, __ATOMIC_RELEASE);
+
+    if (a->brk > a->commit_brk) {
+	/* Commit whole chunks so that small increments rarely trap */
+	commit = a->start_brk + 
+	    (a->brk - a->start_brk + MEM_COMMIT_CHUNK - 1) /
+	    MEM_COMMIT_CHUNK * MEM_COMMIT_CHUNK;
+	if (commit > a->max_addr)
+	    commit = a->max_addr;
+	if (mprotect(a->commit_brk, commit - a->commit_brk,
+		     PROT_READ | PROT_WRITE) != 0) {
+	    __atomic_store_n(&a->brk, old_brk, __ATOMIC_RELEASE);
+#if MM_THREADS
+	    pthread_mutex_unlock(&a->lock);
+#endif
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit memory...\n");
+	    return (void *)-1;
+	}
+	a->commit_brk = commit;
+    } else if (incr < 0 && unit_up(a->brk) < a->commit_brk) {
+	mem_decommit(unit_up(a->brk), a->commit_brk);
+	a->commit_brk = unit_up(a->brk);
+	if (a->dirty_brk > a->commit_brk)
+	    a->dirty_brk = a->commit_brk;
+    }
+    if (a->brk > a->dirty_brk)
+	a->dirty_brk = a->brk;
+
+#if MM_THREADS
+    pthread_mutex_unlock(&a->lock);
+#endif
+    if (incr > 0)
+	mem_update_peak();
     return (void *)old_brk;
 }
 
 /*
- * mem_heap_lo - return address of the first heap byte
+ * mem_map - map a separate region of at least len bytes outside the heap
+ *    and return its address, or NULL if the mapping failed. The region is
+ *    zero-filled and 16-byte aligned.
+ */
+void *mem_map(size_t len)
+{
+    map_t *m;
+    size_t total = (size_t)page_up((char *)(len + sizeof(map_t)));
+
+    m = mem_reserve(total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS);
+    if (m == MAP_FAILED)
+	return NULL;
+    m->len = total;
+#if MM_THREADS
+    pthread_mutex_lock(&mem_lock);
+#endif
+    m->next = mem_maps.next;
+    m->prev = &mem_maps;
+    m->next->prev = m;
+    mem_maps.next = m;
+    __atomic_add_fetch(&mem_mapped, total, __ATOMIC_RELAXED);
+#if MM_THREADS
+    pthread_mutex_unlock(&mem_lock);
+#endif
+    mem_update_peak();
+    return (void *)(m + 1);
+}
+
+/*
+ * mem_remap - resize a region returned by mem_map() to at least len
+ *    bytes, moving it if necessary, and return its new address. Returns
+ *    NULL, leaving the region alone, if it could not be resized.
+ */
+void *mem_remap(void *addr, size_t len)
+{
+    map_t *m = (map_t *)addr - 1;
+    map_t *newm;
+    size_t total = (size_t)page_up((char *)(len + sizeof(map_t)));
+
+    /* The mapping moves, so it must be off the list while it does */
+#if MM_THREADS
+    pthread_mutex_lock(&mem_lock);
+#endif
+    newm = mremap(m, m->len, total, MREMAP_MAYMOVE);
+    if (newm == MAP_FAILED) {
+#if MM_THREADS
+	pthread_mutex_unlock(&mem_lock);
+#endif
+	return NULL;
+    }
+    newm->next->prev = newm;
+    newm->prev->next = newm;
+    __atomic_add_fetch(&mem_mapped, total - newm->len, __ATOMIC_RELAXED);
+    newm->len = total;
+#if MM_THREADS
+    pthread_mutex_unlock(&mem_lock);
+#endif
+    mem_update_peak();
+    return (void *)(newm + 1);
+}
+
+/*
+ * mem_unmap - unmap a region returned by mem_map()
+ */
+void mem_unmap(void *addr)
+{
+    map_t *m = (map_t *)addr - 1;
+
+#if MM_THREADS
+    pthread_mutex_lock(&mem_lock);
+#endif
+    m->next->prev = m->prev;
+    m->prev->next = m->next;
+    __atomic_sub_fetch(&mem_mapped, m->len, __ATOMIC_RELAXED);
+#if MM_THREADS
+    pthread_mutex_unlock(&mem_lock);
+#endif
+    munmap(m, m->len);
+}
+
+/*
+ * mem_mapsize - return the usable size in bytes of a region returned by
+ *    mem_map(); it is at least the length that was asked for
+ */
+size_t mem_mapsize(void *addr)
+{
+    return ((map_t *)addr - 1)->len - sizeof(map_t);
+}
+
+/*
+ * mem_is_heap - return true if [lo, hi] lies within the heap of one
+ *    arena or within a single region returned by mem_map()
+ */
+int mem_is_heap(void *lo, void *hi)
+{
+    map_t *m;
+    int found = 0, i;
+
+    for (i = 0; i < mem_num_arenas; i++)
+	if ((char *)lo >= mem_arena[i].start_brk &&
+	    (char *)hi < mem_arena[i].brk && lo <= hi)
+	    return 1;
+#if MM_THREADS
+    pthread_mutex_lock(&mem_lock);
+#endif
+    for (m = mem_maps.next; m != &mem_maps && !found; m = m->next)
+	found = (char *)lo >= (char *)(m + 1) && (char *)hi < (char *)m + m->len;
+#if MM_THREADS
+    pthread_mutex_unlock(&mem_lock);
+#endif
+    return found;
+}
+
+/*
+ * mem_release - give the whole pages in [addr, addr + len) back to the
+ *    OS, in units of mem_releasesize() bytes. The range stays part of the
+ *    heap and reads back as zeros. Returns the number of bytes released.
+ */
+size_t mem_release(void *addr, size_t len)
+{
+    char *lo = unit_up((char *)addr);
+    char *hi = unit_down((char *)addr + len);
+
+    if (hi <= lo)
+	return 0;
+    if (madvise(lo, hi - lo, MADV_DONTNEED) != 0)
+	return 0;
+    return (size_t)(hi - lo);
+}
+
+/*
+ * mem_is_zero - return true if every heap byte from addr up, addr being
+ *    at or above the brk, is known to read as zero.  That is the case for
+ *    pages that have not been part of the heap since they were committed
+ *    or decommitted, but not for pages that mem_reset_brk() kept.
+ */
+int mem_is_zero(void *addr)
+{
+    int zero = 0, i;
+
+    for (i = 0; i < mem_num_arenas; i++)
+	if ((char *)addr >= mem_arena[i].start_brk &&
+	    (char *)addr <= mem_arena[i].max_addr) {
+#if MM_THREADS
+	    pthread_mutex_lock(&mem_arena[i].lock);
+#endif
+	    zero = (char *)addr >= mem_arena[i].dirty_brk;
+#if MM_THREADS
+	    pthread_mutex_unlock(&mem_arena[i].lock);
+#endif
+	}
+    return zero;
+}
+
+/*
+ * mem_heap_lo - return address of the first heap byte of arena 0
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_arena_lo(0);
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_heap_hi - return address of last heap byte of arena 0
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_arena_hi(0);
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_heapsize() - returns the heap size in bytes, over every arena
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < mem_num_arenas; i++)
+	size += mem_arena_size(i);
+    return size;
+}
+
+/*
+ * mem_arenas - return the number of arenas
+ */
+int mem_arenas(void)
+{
+    return mem_num_arenas;
+}
+
+/*
+ * mem_home - return the arena of the NUMA node that the calling thread
+ *    is running on.  Threads move between nodes, so this is a hint.
+ */
+int mem_home(void)
+{
+    static __thread int fake_node = -1;
+    unsigned cpu, node;
+
+    if (mem_num_arenas == 1)
+	return 0;
+    if (mem_fake_nodes > 0) {
+	if (fake_node < 0)
+	    fake_node = __atomic_fetch_add(&mem_next_node, 1,
+					   __ATOMIC_RELAXED) % mem_fake_nodes;
+	return fake_node % mem_num_arenas;
+    }
+    if (getcpu(&cpu, &node) != 0)
+	return 0;
+    return node % mem_num_arenas;
+}
+
+/*
+ * mem_arena_of - return the arena whose heap holds addr, or -1
+ */
+int mem_arena_of(void *addr)
+{
+    int i;
+
+    for (i = 0; i < mem_num_arenas; i++)
+	if ((char *)addr >= mem_arena[i].start_brk &&
+	    (char *)addr < mem_arena[i].brk)
+	    return i;
+    return -1;
+}
+
+/*
+ * mem_arena_lo - return address of the first heap byte of an arena
+ */
+void *mem_arena_lo(int arena)
+{
+    return (void *)mem_arena[arena].start_brk;
+}
+
+/*
+ * mem_arena_hi - return address of the last heap byte of an arena
+ */
+void *mem_arena_hi(int arena)
+{
+    return (void *)(mem_arena[arena].brk - 1);
+}
+
+/*
+ * mem_arena_size - return the heap size of an arena in bytes
+ */
+size_t mem_arena_size(int arena)
+{
+    return (size_t)(__atomic_load_n(&mem_arena[arena].brk, __ATOMIC_ACQUIRE) -
+		    mem_arena[arena].start_brk);
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest number of bytes held by the
+ *    heap plus all mappings since the last mem_reset_brk()
+ */
+size_t mem_peak_heapsize()
+{
+    return mem_peak;
 }
 
 /*
@@ -99,3 +528,159 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_releasesize() - returns the unit that mem_release() gives pages
+ *    back in: the page size, or the huge page size with MM_HUGEPAGES
+ */
+size_t mem_releasesize()
+{
+    return (size_t)MEM_RELEASE_UNIT;
+}
+
+/*
+ * mem_nodes - return the number of NUMA nodes, counting up to the
+ *    highest one that is online.  It reads the list with read() rather
+ *    than stdio, since mem_init() may run inside the first malloc() of a
+ *    program that the allocator replaces malloc() for.
+ */
+static int mem_nodes(void)
+{
+    char buf[256], *p, *end;
+    long hi;
+    ssize_t len;
+    int fd, nodes = 1;
+
+    if ((fd = open("/sys/devices/system/node/online", O_RDONLY)) < 0)
+	return 1;
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+	return 1;
+    buf[len] = '\0';
+
+    /* A list of ranges such as "0-1,3" */
+    for (p = buf; ; p = end + 1) {
+	hi = strtol(p, &end, 10);
+	if (end == p)
+	    break;
+	if (*end == '-')
+	    hi = strtol(end + 1, &end, 10);
+	if (hi + 1 > nodes)
+	    nodes = hi + 1;
+	if (*end != ',')
+	    break;
+    }
+    return nodes;
+}
+
+/*
+ * mem_bind - make the pages of an arena prefer a node.  Pages are only
+ *    placed when they are first touched, so this is set before they are.
+ *    Kernels without NUMA support refuse it, which is harmless.
+ */
+static void mem_bind(arena_t *a, int node)
+{
+    unsigned long mask[4] = {0};
+
+    if (node >= (int)(8 * sizeof(mask)))
+	return;
+    mask[node / (8 * sizeof(mask[0]))] = 1UL << (node % (8 * sizeof(mask[0])));
+    syscall(SYS_mbind, a->start_brk, MAX_HEAP, MPOL_PREFERRED, mask,
+	    8 * sizeof(mask), 0);
+}
+
+/*
+ * mem_reserve - mmap() len bytes, a multiple of the page size.  With
+ *    MM_HUGEPAGES, a region of at least a huge page starts on a huge page
+ *    boundary and is advised to be backed by huge pages.  Returns
+ *    MAP_FAILED if the mapping failed.
+ */
+static void *mem_reserve(size_t len, int prot, int flags)
+{
+#if MM_HUGEPAGES
+    char *p, *lo;
+
+    if (len < HUGE_PAGE_SIZE)
+	return mmap(NULL, len, prot, flags, -1, 0);
+
+    /* Map a huge page more than needed and unmap the ends around a
+       huge page boundary */
+    p = mmap(NULL, len + HUGE_PAGE_SIZE, prot, flags, -1, 0);
+    if (p == MAP_FAILED)
+	return MAP_FAILED;
+    lo = (char *)(((uintptr_t)p + HUGE_PAGE_SIZE - 1) &
+		  ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (lo > p)
+	munmap(p, lo - p);
+    if (lo < p + HUGE_PAGE_SIZE)
+	munmap(lo + len, p + HUGE_PAGE_SIZE - lo);
+    madvise(lo, len, MADV_HUGEPAGE);
+    return lo;
+#else
+    return mmap(NULL, len, prot, flags, -1, 0);
+#endif
+}
+
+/*
+ * page_down - round p down to a page boundary
+ */
+static char *page_down(char *p)
+{
+    return (char *)((uintptr_t)p & ~(uintptr_t)(mem_pagesize() - 1));
+}
+
+/*
+ * page_up - round p up to a page boundary
+ */
+static char *page_up(char *p)
+{
+    return page_down(p + mem_pagesize() - 1);
+}
+
+/*
+ * unit_down - round p down to a boundary of the unit that pages are
+ *    decommitted and released in
+ */
+static char *unit_down(char *p)
+{
+    return (char *)((uintptr_t)p & ~(uintptr_t)(MEM_RELEASE_UNIT - 1));
+}
+
+/*
+ * unit_up - round p up to a boundary of the unit that pages are
+ *    decommitted and released in
+ */
+static char *unit_up(char *p)
+{
+    return unit_down(p + MEM_RELEASE_UNIT - 1);
+}
+
+/*
+ * mem_update_peak - record the current footprint if it is a new peak.
+ *    Called without any lock, after the arena or mapping has grown, so
+ *    the footprint of concurrent growth is counted by one caller or other.
+ */
+static void mem_update_peak(void)
+{
+    size_t footprint = mem_heapsize() +
+	__atomic_load_n(&mem_mapped, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&mem_peak, __ATOMIC_RELAXED);
+
+    while (footprint > peak &&
+	   !__atomic_compare_exchange_n(&mem_peak, &peak, footprint, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	;
+}
+
+/*
+ * mem_decommit - drop the page-aligned range [lo, hi) and make it
+ *    inaccessible again
+ */
+static void mem_decommit(char *lo, char *hi)
+{
+    if (hi <= lo)
+	return;
+    madvise(lo, hi - lo, MADV_DONTNEED);
+    mprotect(lo, hi - lo, PROT_NONE);
+}
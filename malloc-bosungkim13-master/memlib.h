@@ -2,7 +2,24 @@ void mem_init(void);
 void mem_deinit(void);
 void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
+size_t mem_release(void *addr, size_t len);
+void *mem_map(size_t len);
+void *mem_remap(void *addr, size_t len);
+void mem_unmap(void *addr);
+size_t mem_mapsize(void *addr);
+int mem_is_heap(void *lo, void *hi);
+int mem_is_zero(void *addr);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_releasesize(void);
+
+int mem_arenas(void);
+int mem_home(void);
+int mem_arena_of(void *addr);
+void *mem_arena_sbrk(int arena, intptr_t incr);
+void *mem_arena_lo(int arena);
+void *mem_arena_hi(int arena);
+size_t mem_arena_size(int arena);
@@ -13,15 +13,27 @@
  * as a pointer, i.e., sizeof(uintptr_t) == sizeof(void *).
  */
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
+#include "config.h"
 #include "memlib.h"
 #include "mm.h"
 
+#if MM_PROFILE
+#include <execinfo.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
  * provide your team information in the following struct.
@@ -42,15 +54,192 @@ team_t team = {
 /* Basic constants and macros: */
 #define WSIZE      sizeof(void *) /* Word and header/footer size (bytes) */
 #define DSIZE      (2 * WSIZE)    /* Doubleword size (bytes) */
-#define CHUNKSIZE  (1 << 12)      /* Extend heap by this amount (bytes) */
+#define CHUNKSIZE  (1 << 12)      /* Initial heap extension (bytes) */
+#define GROW_RATIO (128)          /* Heap grows by at least 1/GROW_RATIO of its size */
+#define GROW_MAX   (64 * 1024)    /* ... but by no more than this for that reason */
+#define PURGE_INTERVAL (4096)     /* Frees between returns of memory to the OS */
+#define TRIM_THRESHOLD (256 * 1024)   /* Shrink the heap by a free top block this large */
+#define TRIM_KEEP (64 * 1024)         /* Free bytes left at the top after a trim */
+#define RELEASE_THRESHOLD (MM_HUGEPAGES ? HUGE_PAGE_SIZE : 256 * 1024) /* Return pages of free blocks this large */
+#define FREE_META (4 * DSIZE)     /* Free block payload bytes used for links */
+#define MMAP_THRESHOLD (1024 * 1024)  /* Map requests this large on their own */
+#define HEADROOM_MAX (64 * 1024)  /* Most extra bytes a growing block gets */
+#define CHECK_SLICE (64)          /* Blocks the sampling checker walks at once */
 #define ALIGN (16)
-#define NUM (16)
+#define NUM (32)                  /* Number of segregated free lists */
+#define BIN_SUB_BITS (2)          /* log2 of bins per power of two */
+#define BIN_SUBS (1 << BIN_SUB_BITS)
+#define MINBIN_SIZE (2 * DSIZE)   /* Smallest block size, first bin */
+#define TREE_BIN (NUM - 1)        /* The bin kept as a tree instead of a list */
+
+/*
+ * Requests of at most SLAB_MAX bytes are served from runs: RUNSIZE-byte,
+ * RUNSIZE-aligned allocated blocks that hold objects of a single size class
+ * and no per-object boundary tags.
+ */
+#define RUNSIZE (1 << 12)
+#define SLAB_MAX (64)
+#define NSLAB (SLAB_MAX / ALIGN)  /* Number of slab size classes */
+#define RUNMAP_BITS (8 * sizeof(unsigned long))
+#define RUNMAP_WORDS ((MAX_HEAP / RUNSIZE + 1 + RUNMAP_BITS - 1) / RUNMAP_BITS)
+
+/*
+ * With MM_HUGEPAGES, the heap grows and is trimmed to huge page boundaries,
+ * and new runs are carved from RUN_CHUNK-byte allocated blocks that each
+ * fill a huge page.  Small objects then come and go without pinning the
+ * huge pages of the heap around them, and the release of a large free
+ * block's pages never has to split one.  A run that becomes empty waits
+ * in its chunk for reuse.  RUN_BLOCK() is the allocated block that holds
+ * a run.
+ */
+#if MM_HUGEPAGES
+#define RUN_CHUNK (HUGE_PAGE_SIZE)
+#define RUN_BLOCK(run) ((void *)((uintptr_t)(run) & ~(uintptr_t)(RUN_CHUNK - 1)))
+#define HUGE_SLACK(p)  (-(uintptr_t)(p) & (HUGE_PAGE_SIZE - 1))
+#else
+#define RUN_BLOCK(run) ((void *)(run))
+#define HUGE_SLACK(p)  ((uintptr_t)0)
+#endif
+
+/*
+ * With MM_BINS naming a header that "mdriver -B" wrote, find_explicit()
+ * looks bins up in its table instead of computing them.
+ */
+#ifdef MM_BINS
+#include MM_BINS
+_Static_assert(BIN_NUM == NUM && BIN_ALIGN == ALIGN && BIN_SLAB_MAX == SLAB_MAX,
+    "the bin table was made for this allocator's block sizes");
+#endif
+
+/*
+ * With MM_THREADS, the heap is split into arenas, one per NUMA node that
+ * memlib found, and each thread allocates from the arena of its node.  A
+ * freed block goes back to the arena whose heap holds it.  Every thread
+ * also keeps a small cache of recently freed blocks of its own arena per
+ * TCACHE class, and all other allocator state is protected by the lock of
+ * the arena it belongs to.  A class is a slab class or an exact block size of at most
+ * TCACHE_MAX bytes.  Caches exchange blocks with the heap TCACHE_BATCH
+ * at a time.
+ */
+#define TCACHE_MAX (1024)
+#define NTCACHE (TCACHE_MAX / ALIGN)
+#define TCACHE_COUNT (32)          /* Blocks per class before a flush */
+#define TCACHE_BATCH (8)           /* Blocks moved per refill or flush */
+#define TCACHE_BATCH_BYTES (4096)  /* Cap on the bytes moved per refill */
+#define HOME_RECHECK (256)         /* Lookups of a thread's arena between checks of its node */
+
+/*
+ * With MM_QUICKLISTS, freed blocks of at most QUICK_MAX bytes stay marked
+ * allocated on a list per exact size.  They are coalesced together once a
+ * fit isn't found or QUICK_LIMIT bytes are waiting.
+ */
+#define QUICK_MAX (1024)
+#define NQUICK (QUICK_MAX / ALIGN)
+#define QUICK_LIMIT (64 * 1024)
+
+/*
+ * HEAP_LOCK() locks an arena and makes it the one that "heap" refers to,
+ * and HOME_LOCK() locks the calling thread's own arena.
+ */
+#if MM_THREADS
+#define NARENAS        MM_ARENAS
+#define HEAP_LOCK(a)   heap_lock(a)
+#define HEAP_UNLOCK()  pthread_mutex_unlock(&heap->lock)
+#define HOME_LOCK()    home_lock()
+#else
+#define NARENAS        1
+#define HEAP_LOCK(a)   ((void)(a))
+#define HEAP_UNLOCK()  ((void)0)
+#define HOME_LOCK()    ((void)0)
+#endif
+
+/* Check the blocks around "bp" if the sampling checker is on. */
+#define CHECK(bp)  do {							\
+	if (check_interval != 0)					\
+		checktouched(bp);					\
+} while (0)
+
+/* Evaluate "expr" only if the allocator keeps statistics. */
+#if MM_STATS
+#define STAT(expr)  ((void)(expr))
+#else
+#define STAT(expr)  ((void)0)
+#endif
+
+/*
+ * With MM_PROFILE, every thread counts down the bytes it allocates and
+ * samples the allocation that takes the count below zero.  The intervals
+ * are exponentially distributed with a mean of prof_rate bytes, so a
+ * block of "size" bytes is sampled with probability 1 - exp(-size /
+ * prof_rate).  A free only looks a block up in the table of samples if
+ * its slot in prof_hints is nonzero.
+ */
+#define PROF_DEPTH (32)           /* Frames kept per sampled stack */
+#define PROF_SKIP (2)             /* Frames of the allocator itself */
+#define PROF_BUCKETS (4096)       /* Hash chains of distinct stacks */
+#define PROF_HINTS (4096)         /* Counters of samples by address hash */
+#define PROF_SAMPLES (1024)       /* Initial slots in the sample table */
+#define PROF_IDLE (1L << 20)      /* Bytes between checks while off */
+#define PROF_POOL (64 * 1024)     /* Bytes of stacks mapped at a time */
+
+#if MM_PROFILE
+#define PROF_HINT(bp)  ((uintptr_t)(bp) * 0x9E3779B97F4A7C15ULL >> 52)
+#define PROF_SLOT(bp, mask)						\
+    (((uintptr_t)(bp) * 0x9E3779B97F4A7C15ULL >> 20) & (mask))
+/* Each argument is evaluated exactly once, as if these were functions. */
+#define PROF_ALLOC(bp, size)  do {					\
+	void *prof_bp = (bp);						\
+	size_t prof_size = (size);					\
+									\
+	if (prof_bp != NULL &&						\
+	    (prof_countdown -= (long)prof_size) <= 0)			\
+		prof_sample(prof_bp, prof_size);			\
+} while (0)
+#define PROF_FREE(bp)  do {						\
+	void *prof_bp = (bp);						\
+									\
+	if (__atomic_load_n(&prof_hints[PROF_HINT(prof_bp)],		\
+	    __ATOMIC_RELAXED) != 0)					\
+		prof_free(prof_bp);					\
+} while (0)
+#define PROF_MOVE(bp, newbp, size)  do {				\
+	void *prof_bp = (bp), *prof_newbp = (newbp);			\
+	size_t prof_size = (size);					\
+									\
+	if (prof_newbp != NULL && __atomic_load_n(			\
+	    &prof_hints[PROF_HINT(prof_bp)], __ATOMIC_RELAXED) != 0)	\
+		prof_move(prof_bp, prof_newbp, prof_size);		\
+} while (0)
+#if MM_THREADS
+#define PROF_LOCK()    pthread_mutex_lock(&prof_lock)
+#define PROF_UNLOCK()  pthread_mutex_unlock(&prof_lock)
+#else
+#define PROF_LOCK()
+#define PROF_UNLOCK()
+#endif
+#else
+#define PROF_ALLOC(bp, size)  ((void)(bp), (void)(size))
+#define PROF_FREE(bp)  ((void)(bp))
+#define PROF_MOVE(bp, newbp, size)  ((void)(bp), (void)(newbp), (void)(size))
+#endif
 
 #define MAX(x, y)  ((x) > (y) ? (x) : (y))  
-#define BIN(x) __builtin_clz(x)
+#define MIN(x, y)  ((x) < (y) ? (x) : (y))
+/* Floor of the base-2 logarithm of a nonzero size. */
+#define LOG2(x) ((int)(sizeof(unsigned long) * 8 - 1) - \
+    __builtin_clzl((unsigned long)(x)))
 
 
-/* Pack a size and allocated bit into a word. */
+/*
+ * Header flag bits.  Only free blocks have a footer, so each header also
+ * records whether the block before it is allocated.
+ */
+#define ALLOC       (0x1)
+#define PREV_ALLOC  (0x2)
+#define MMAPPED     (0x4)   /* Allocated block with a mapping of its own */
+#define ZEROED      (0x8)   /* Free block that is zero past FREE_META bytes */
+
+/* Pack a size and flag bits into a word. */
 #define PACK(size, alloc)  ((size) | (alloc))
 
 /* Read and write a word at address p. */
@@ -59,34 +248,211 @@ team_t team = {
 
 /* Read the size and allocated fields from address p. */
 #define GET_SIZE(p)   (GET(p) & ~(DSIZE - 1))
-#define GET_ALLOC(p)  (GET(p) & 0x1)
+#define GET_ALLOC(p)  (GET(p) & ALLOC)
+#define GET_PREV_ALLOC(p)  (GET(p) & PREV_ALLOC)
+#define GET_MMAPPED(p)  (GET(p) & MMAPPED)
+#define GET_ZEROED(p)  (GET(p) & ZEROED)
+
+/* Set or clear the previous-block-allocated bit of the header at p. */
+#define SET_PREV_ALLOC(p)  (GET(p) |= PREV_ALLOC)
+#define CLR_PREV_ALLOC(p)  (GET(p) &= ~(uintptr_t)PREV_ALLOC)
 
-/* Given block ptr bp, compute address of its header and footer. */
+/*
+ * Given block ptr bp, compute address of its header and footer.  The footer
+ * is only meaningful if the block is free.
+ */
 #define HDRP(bp)  ((char *)(bp) - WSIZE)
 #define FTRP(bp)  ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
-/* Given block ptr bp, compute address of next and previous blocks. */
+/*
+ * Given block ptr bp, compute address of next and previous blocks.  The
+ * previous block can only be found if it is free.
+ */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/*
+ * The heap of one arena.  memlib gives each arena a heap of its own, and
+ * each block only ever lies in the heap it was carved from, so an
+ * arena's blocks, bins and runs are all its own.  Everything here is
+ * protected by the arena's lock.
+ */
+struct arena {
+#if MM_THREADS
+	pthread_mutex_t lock;
+	unsigned int gen;          /* heap_gen when the heap was set up */
+	void *remote_frees;        /* Lock-free stack of deferred frees */
+#endif
+	int index;                 /* The arena's number in memlib */
+	char *lo;                  /* The start of its heap */
+	char *heap_listp;          /* Pointer to first block */
+	struct Node *free_lists;
+	unsigned long bin_map;     /* Bit i is set iff free_lists[i] is non-empty */
+	struct TreeNode *tree_root; /* Free blocks in TREE_BIN */
+	struct run *partial_runs[NSLAB]; /* Runs with a free slot, by class */
+	unsigned long run_map[RUNMAP_WORDS]; /* Heap pages that start a run */
+#if MM_HUGEPAGES
+	char *chunk_next;          /* The next unused run of the newest chunk... */
+	char *chunk_end;           /* ... which ends here */
+	struct run *idle_runs;     /* Empty runs, linked by "next" */
+#endif
+	unsigned int frees_since_purge;
+	unsigned int check_ops;    /* Operations since the last slice */
+	char *check_cursor;        /* Next block of the checker's walk */
+#if MM_QUICKLISTS
+	void *quick_lists[NQUICK]; /* Freed blocks not yet coalesced, by size */
+	size_t quick_bytes;        /* Bytes held on quick_lists */
+#endif
+#if MM_STATS
+	struct mm_stats stats;     /* Heap counters */
+	unsigned int fit_probes;   /* Blocks examined by the current search */
+#endif
+};
+
 /* Global variables: */
-static char *heap_listp; /* Pointer to first block */  
-struct Node *free_lists;
+#if MM_THREADS
+static struct arena arenas[NARENAS] = {
+	[0 ... NARENAS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+static __thread struct arena *heap;  /* The arena this thread has locked */
+static __thread struct arena *home;  /* The arena of this thread's node */
+static __thread unsigned int home_ops; /* Lookups of "home" since its last update */
+#else
+static struct arena arenas[NARENAS];
+static struct arena *heap = &arenas[0];
+#endif
+static int num_arenas;              /* Arenas that memlib has heaps for */
+static unsigned int check_interval; /* Operations per checked slice, or 0 */
+static mm_check_fail_t check_fail;  /* Receives failed checks, or NULL */
+#if MM_THREADS
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;   /* Flushes a thread's cache at exit */
+static unsigned int heap_gen;      /* Bumped by mm_init() to drop caches */
+static __thread struct tcache tcache;
+#endif
+#if MM_STATS
+static struct op_stats op_stats; /* Calls by threads that have exited */
+#if MM_THREADS
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tcache *tcache_list; /* Caches of threads with counters */
+static unsigned char tcache_bins[NTCACHE]; /* The bin of each cache class */
+#endif
+_Static_assert(MM_STATS_BINS == NUM, "struct mm_stats has a counter per bin");
+#endif
+#if MM_PROFILE
+static size_t prof_rate;          /* Mean bytes between samples, or 0 */
+static unsigned int prof_hints[PROF_HINTS]; /* Samples by address hash */
+static struct prof_sample *prof_samples; /* Sampled blocks by address */
+static size_t prof_mask;          /* Slots in prof_samples - 1 */
+static size_t prof_used;          /* Slots in use in prof_samples */
+static struct prof_bucket *prof_buckets[PROF_BUCKETS]; /* Stacks by hash */
+static char *prof_pool;           /* Unused memory for new stacks... */
+static size_t prof_pool_left;     /* ... of this many bytes */
+static __thread long prof_countdown; /* Bytes until the next sample */
+static __thread bool prof_armed;     /* prof_countdown is an interval */
+static __thread bool prof_busy;      /* Inside the profiler already */
+static __thread uint64_t prof_rng;   /* xorshift64* state */
+#if MM_THREADS
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+#endif
 
 
 /* Function prototypes for internal helper routines: */
+static int arena_init(struct arena *a);
+static struct arena *arena_of(void *bp);
+#if MM_THREADS
+static void heap_lock(struct arena *a);
+static bool heap_trylock(struct arena *a);
+static void home_lock(void);
+static struct arena *home_arena(void);
+#endif
 static void *coalesce(void *bp);
 static void *extend_heap(size_t words);
+static void *grow_heap(size_t asize);
 static void *find_fit(size_t asize);
+static void *bin_fit(size_t asize);
+static void free_block(void *bp);
+static void *heap_calloc(size_t asize, bool *zeroed);
+static uintptr_t zero_seam(void *lower, void *upper);
+#if MM_QUICKLISTS
+static void quick_flush(void);
+#endif
 static void place(void *bp, size_t asize);
+static size_t place_batch(void *bp, size_t asize, size_t n, void **out);
+static int addr_cmp(const void *a, const void *b);
 static void insertBlock(void *bp);
 static void deleteBlock(void *bp);
 static int find_explicit(size_t size);
+static void *tree_fit(size_t asize);
+static struct TreeNode *tree_insert(struct TreeNode *t, struct TreeNode *node);
+static struct TreeNode *tree_delete(struct TreeNode *t, struct TreeNode *node);
+static void tree_release(struct TreeNode *t);
+static bool tree_before(void *a, void *b);
+static uintptr_t tree_priority(void *bp);
+static size_t adjust_size(size_t size);
+static void *alloc_aligned(size_t asize, size_t align);
+static void *slab_malloc(size_t size);
+static void slab_free(struct run *run, void *bp);
+static struct run *slab_run(struct arena *a, void *bp);
+static struct run *run_alloc(void);
+static void *malloc_block(size_t size);
+static void *heap_malloc(size_t size);
+static void heap_free(void *bp);
+static void purge(void);
+static void *heap_realloc(void *bp, size_t asize);
+static size_t realloc_headroom(size_t asize, size_t oldsize);
+static void split_tail(void *bp, size_t keep);
+static void *mmap_malloc(size_t size, size_t align);
+static void *mmap_realloc(void *bp, size_t size);
+static void mmap_free(void *bp);
+#if MM_THREADS
+static int tcache_class(size_t size);
+static int tcache_block_class(void *bp, struct run *run);
+static struct tcache *tcache_get(void);
+static void tcache_put(struct tcache *tc, int class, void *bp);
+static void *tcache_refill(struct tcache *tc, int class, size_t size);
+static void tcache_flush(struct tcache *tc, int class, unsigned int n);
+static void tcache_init_key(void);
+static void tcache_destroy(void *arg);
+static void remote_push(struct arena *a, void *first, void *last);
+static void remote_drain(void);
+#endif
+#if MM_STATS
+static void stats_add(struct mm_stats *st, const struct mm_stats *a);
+static int stat_bin(size_t size);
+static struct op_stats *stat_ops(void);
+static inline void stat_malloc(struct op_stats *ops, int bin, unsigned long n);
+static inline void stat_free(struct op_stats *ops, int bin, unsigned long n);
+static void stat_probes(void);
+#endif
+#if MM_PROFILE
+struct prof_out;
+static void prof_sample(void *bp, size_t size);
+static void prof_free(void *bp);
+static void prof_move(void *bp, void *newbp, size_t size);
+static void prof_reset(void);
+static long prof_interval(size_t rate);
+static struct prof_bucket *prof_bucket(void **pcs, int depth);
+static struct prof_sample *prof_find(void *bp);
+static void prof_remove(struct prof_sample *sample);
+static bool prof_grow(void);
+static void prof_put(struct prof_out *out, const char *fmt, ...);
+#endif
 
 /* Function prototypes for heap consistency checker routines: */
 static void checkblock(void *bp);
 static void checkheap(bool verbose);
 static void printblock(void *bp); 
+static void checktree(struct TreeNode *t, void *lo, void *hi);
+static void checkfail(const char *msg, void *bp);
+static bool checkptr(void *p);
+static bool checktags(void *bp);
+static void checklinks(void *bp);
+static void checkobject(struct run *run, void *bp);
+static void checktouched(void *bp);
+static void checkslice(void);
+static void check_absorb(void *bp, size_t size);
 
 
 struct Node{
@@ -94,6 +460,98 @@ struct Node{
 	struct Node* prev;
 };
 
+/*
+ * A free block in TREE_BIN is a node of a treap ordered by size and then
+ * by address.  A node's priority is a hash of its address, so it needs no
+ * storage and the tree stays balanced in expectation.
+ */
+struct TreeNode{
+	struct TreeNode* left;
+	struct TreeNode* right;
+};
+
+/*
+ * The header at the start of every run.  Objects start at the first ALIGN
+ * boundary after the header.  Freed objects are kept on a singly-linked
+ * list threaded through their first word; objects that have never been
+ * handed out lie between "bump" and "end".
+ */
+struct run {
+	struct run *next;     /* Next run in partial_runs[], or NULL */
+	struct run *prev;     /* Previous run in partial_runs[], or NULL */
+	void *free;           /* First freed object */
+	char *bump;           /* First never-allocated object */
+	char *end;            /* End of the object area */
+	unsigned int size;    /* Object size in bytes */
+	unsigned int nused;   /* Number of allocated objects */
+	unsigned int nobjs;   /* Capacity of the run */
+};
+
+/*
+ * Counts of the calls made to the allocator.  With MM_THREADS, each thread
+ * counts its own calls in its cache, and only that thread writes them.
+ */
+struct op_stats {
+	unsigned long mallocs[NUM];
+	unsigned long frees[NUM];
+};
+
+/*
+ * A thread's cache of freed blocks.  Cached blocks stay marked allocated in
+ * the heap and are linked through their first payload word.  A cache whose
+ * "gen" differs from heap_gen refers to a heap that mm_init() discarded.
+ */
+struct tcache {
+	unsigned int gen;
+	bool registered;
+	unsigned int count[NTCACHE];
+	void *head[NTCACHE];
+#if MM_STATS
+	struct op_stats ops;
+	struct tcache *next;  /* Next cache on tcache_list */
+	struct tcache *prev;  /* Previous cache on tcache_list */
+#endif
+};
+
+/*
+ * The sampled allocations that were made from one call stack, and the
+ * ones among them that are still live.
+ */
+struct prof_bucket {
+	struct prof_bucket *next;   /* Next stack with the same hash slot */
+	uintptr_t hash;
+	int depth;                  /* Frames in "pcs" */
+	size_t live_count;
+	size_t live_bytes;
+	size_t alloc_count;
+	size_t alloc_bytes;
+	void *pcs[PROF_DEPTH];
+};
+
+/* A sampled block that is still allocated.  "addr" is 0 if unused. */
+struct prof_sample {
+	uintptr_t addr;
+	size_t size;                /* Bytes that were requested */
+	struct prof_bucket *bucket;
+};
+
+/* A buffer for writing a profile without calling malloc(). */
+struct prof_out {
+	int fd;
+	bool error;
+	size_t len;
+	char buf[4096];
+};
+
+#define RUN_HDRSIZE (ALIGN * ((sizeof(struct run) + ALIGN - 1) / ALIGN))
+
+/* The run that contains the object "bp". */
+#define RUN_OF(bp) ((struct run *)((uintptr_t)(bp) & ~(uintptr_t)(RUNSIZE - 1)))
+
+/* Index of the RUNSIZE-sized page of the heap of arena "a" that contains "p". */
+#define RUN_PAGE(a, p) (((uintptr_t)(p) / RUNSIZE) - \
+    ((uintptr_t)(a)->lo / RUNSIZE))
+
 
 
 /* 
@@ -107,31 +565,32 @@ struct Node{
 int
 mm_init(void) 
 {
-	char* temp;
-	if ((temp = mem_sbrk(NUM * DSIZE)) == (void*)-1){
-		return (-1);
+	int ret;
+
+#if MM_THREADS
+	/* The other arenas are set up again when a thread first uses them. */
+	pthread_mutex_lock(&arenas[0].lock);
+	heap = &arenas[0];
+	heap_gen++;
+#endif
+#if MM_STATS
+	memset(&op_stats, 0, sizeof(op_stats));
+#if MM_THREADS
+	for (int i = 0; i < NTCACHE; i++)
+		tcache_bins[i] = find_explicit((i + 1) * ALIGN);
+#endif
+#endif
+#if MM_PROFILE
+	prof_reset();
+#endif
+	num_arenas = MIN(mem_arenas(), NARENAS);
+	for (int i = 0; i < num_arenas; i++) {
+		arenas[i].index = i;
+		arenas[i].lo = mem_arena_lo(i);
 	}
-	free_lists = (struct Node*)temp;
-	for (unsigned int i = 0; i < NUM; i++){
-		struct Node* cur = free_lists + i;
-		cur->next = cur;
-		cur->prev = cur;
-	}
-
-	if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1) // changed mem_sbrk to match new inital heap
-		return (-1);
-
-	PUT(heap_listp, 0);                            /* Alignment padding */
-	PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); /* Prologue header */ 
-	PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); /* Prologue footer */ 
-	PUT(heap_listp + (3 * WSIZE), PACK(0, 1));     /* Epilogue header */
-
-	heap_listp += (2 * WSIZE);
-	
-	/* Extend the empty heap with a free block of CHUNKSIZE bytes. */
-	if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
-		return (-1);
-	return (0);
+	ret = arena_init(&arenas[0]);
+	HEAP_UNLOCK();
+	return (ret);
 }
 
 /* 
@@ -146,31 +605,63 @@ mm_init(void)
 void *
 mm_malloc(size_t size) 
 {
-	size_t asize;      /* Adjusted block size */
-	size_t extendsize; /* Amount to extend heap if no fit */
+	void *bp = malloc_block(size);
+
+	PROF_ALLOC(bp, size);
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Does the work of mm_malloc(), except for sampling the block for the
+ *   heap profiler.
+ */
+static inline void *
+malloc_block(size_t size)
+{
 	void *bp;
+#if MM_THREADS
+	struct tcache *tc;
+	int class;
+#endif
 
 	/* Ignore spurious requests. */
 	if (size == 0)
 		return (NULL);
 
-	/* Adjust block size to include overhead and alignment reqs. */
-	if (size <= DSIZE)
-		asize = 2 * DSIZE;
-	else
-		asize = (ALIGN * ((size + (ALIGN - 1)) / ALIGN)) + DSIZE;
+	/* Huge requests get a mapping of their own, outside of the heap. */
+	if (size >= MMAP_THRESHOLD) {
+		STAT(stat_malloc(stat_ops(), stat_bin(size), 1));
+		return (mmap_malloc(size, ALIGN));
+	}
 
-	/* Search the free list for a fit. */
-	if ((bp = find_fit(asize)) != NULL) {
-		place(bp, asize);
+#if MM_THREADS
+	/* Take a cached block of the right class without locking. */
+	if ((class = tcache_class(size)) >= 0) {
+		tc = tcache_get();
+		STAT(stat_malloc(&tc->ops, tcache_bins[class], 1));
+		if ((bp = tc->head[class]) != NULL) {
+			tc->head[class] = *(void **)bp;
+			tc->count[class]--;
+			return (bp);
+		}
+		HOME_LOCK();
+		remote_drain();
+		bp = tcache_refill(tc, class, size);
+		HEAP_UNLOCK();
 		return (bp);
 	}
-
-	/* No fit found.  Get more memory and place the block. */
-	extendsize = asize + (2 * WSIZE);
-	if ((bp = extend_heap(extendsize / WSIZE)) == NULL)  
-		return (NULL);
-	place(bp, asize);
+#endif
+	STAT(stat_malloc(stat_ops(), stat_bin(size), 1));
+	HOME_LOCK();
+#if MM_THREADS
+	remote_drain();
+#endif
+	bp = heap_malloc(size);
+	HEAP_UNLOCK();
 	return (bp);
 } 
 
@@ -184,146 +675,2266 @@ mm_malloc(size_t size)
 void
 mm_free(void *bp)
 {
-	size_t size;
+	struct run *run;
+	struct arena *a;
+#if MM_THREADS
+	struct tcache *tc;
+	int class;
+#endif
+
 	/* Ignore spurious requests. */
 	if (bp == NULL)
 		return;
+	PROF_FREE(bp);
+	a = arena_of(bp);
+	run = slab_run(a, bp);
+
+	/* A mapped block is unmapped without touching the heap. */
+	if (run == NULL && GET_MMAPPED(HDRP(bp))) {
+		STAT(stat_free(stat_ops(), TREE_BIN, 1));
+		mmap_free(bp);
+		return;
+	}
 
-	/* Free and coalesce the block. */
-	size = GET_SIZE(HDRP(bp));
-	PUT(HDRP(bp), PACK(size, 0));
-	PUT(FTRP(bp), PACK(size, 0));
-	bp = coalesce(bp);
+#if MM_THREADS
+	/*
+	 * Keep a block of this thread's own arena in its cache, flushing the
+	 * cache when it is full.  Other blocks go home to their arenas.
+	 */
+	if (a == home_arena() && (class = tcache_block_class(bp, run)) >= 0) {
+		tc = tcache_get();
+		STAT(stat_free(&tc->ops, tcache_bins[class], 1));
+		tcache_put(tc, class, bp);
+		return;
+	}
+	STAT(stat_free(stat_ops(), find_explicit(run != NULL ? run->size :
+	    GET_SIZE(HDRP(bp))), 1));
+
+	/*
+	 * Rather than wait for the thread that holds the arena's lock, leave
+	 * the block for that thread to free on its next allocation.
+	 */
+	if (!heap_trylock(a)) {
+		remote_push(a, bp, bp);
+		return;
+	}
+#else
+	STAT(stat_free(stat_ops(), find_explicit(run != NULL ? run->size :
+	    GET_SIZE(HDRP(bp))), 1));
+	HEAP_LOCK(a);
+#endif
+	heap_free(bp);
+	HEAP_UNLOCK();
 }
 
 /*
  * Requires:
- *   "ptr" is either the address of an allocated block or NULL.
+ *   "bp" is either NULL or the address of an allocated block that was
+ *   returned for a request of "size" bytes.
  *
  * Effects:
- *   Reallocates the block "ptr" to a block with at least "size" bytes of
- *   payload, unless "size" is zero.  If "size" is zero, frees the block
- *   "ptr" and returns NULL.  If the block "ptr" is already a block with at
- *   least "size" bytes of payload, then "ptr" may optionally be returned.
- *   Otherwise, a new block is allocated and the contents of the old block
- *   "ptr" are copied to that new block.  Returns the address of this new
- *   block if the allocation was successful and NULL otherwise.
+ *   Free a block like mm_free().  The size picks the thread cache class,
+ *   so a block that fits the cache is cached without reading its header.
+ *   Where the block lives is still looked up from the block itself, since
+ *   a block from mm_realloc() or mm_memalign() may be of another kind than
+ *   a fresh block of "size" bytes would be.
+ */
+void
+mm_free_sized(void *bp, size_t size)
+{
+	struct run *run;
+	struct arena *a;
+#if MM_THREADS
+	struct tcache *tc;
+	int class;
+#endif
+
+	if (bp == NULL)
+		return;
+	PROF_FREE(bp);
+
+	/* Mapped blocks lie outside of every arena. */
+	if ((a = arena_of(bp)) == NULL) {
+		STAT(stat_free(stat_ops(), TREE_BIN, 1));
+		mmap_free(bp);
+		return;
+	}
+	run = slab_run(a, bp);
+#if MM_THREADS
+	/*
+	 * The classes of small sizes hold run objects, so a small block that
+	 * isn't in a run, such as one from mm_memalign(), is classed by its
+	 * header instead.
+	 */
+	class = (size <= SLAB_MAX && run == NULL) ?
+	    tcache_block_class(bp, run) : tcache_class(size);
+	if (a == home_arena() && class >= 0) {
+		tc = tcache_get();
+		STAT(stat_free(&tc->ops, tcache_bins[class], 1));
+		tcache_put(tc, class, bp);
+		return;
+	}
+	STAT(stat_free(stat_ops(), stat_bin(size), 1));
+	if (!heap_trylock(a)) {
+		remote_push(a, bp, bp);
+		return;
+	}
+#else
+	STAT(stat_free(stat_ops(), stat_bin(size), 1));
+	(void)size;  /* Only picks a thread cache class */
+	HEAP_LOCK(a);
+#endif
+	if (run != NULL)
+		slab_free(run, bp);
+	else
+		heap_free(bp);
+	HEAP_UNLOCK();
+}
+
+/*
+ * Requires:
+ *   "bp" is either NULL or the address of an allocated block.
+ *
+ * Effects:
+ *   Returns the number of bytes of payload that the block "bp" actually
+ *   has, which is at least the size that was requested for it and may
+ *   all be used by the caller, or 0 if "bp" is NULL.
+ */
+size_t
+mm_usable_size(void *bp)
+{
+	struct run *run;
+
+	if (bp == NULL)
+		return (0);
+	if ((run = slab_run(arena_of(bp), bp)) != NULL)
+		return (run->size);
+	if (GET_MMAPPED(HDRP(bp)))
+		return (GET_SIZE(HDRP(bp)) - DSIZE);
+	return (GET_SIZE(HDRP(bp)) - WSIZE);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Allocate a block with at least "size" bytes of payload whose address is
+ *   a multiple of "alignment", unless "size" is zero or "alignment" is not
+ *   a power of two.  The block may be freed or reallocated like any other.
+ *   Returns the address of this block if the allocation was successful and
+ *   NULL otherwise.
  */
 void *
-mm_realloc(void *ptr, size_t size)
+mm_memalign(size_t alignment, size_t size)
 {
-	
-	size_t oldsize;
-	void *newptr;
-	size_t asize;
-	oldsize = GET_SIZE(HDRP(ptr));
+	void *bp;
 
-	if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + DSIZE + (DSIZE - 1)) / DSIZE);
-	/* If size == 0 then this is just free, and we return NULL. */
-	if (size == 0) {
-		mm_free(ptr);
+	if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0)
 		return (NULL);
-	}
 
-	/* If oldptr is NULL, then this is just malloc. */
-	if (ptr == NULL)
+	/* Every block is already aligned to ALIGN bytes. */
+	if (alignment <= ALIGN)
 		return (mm_malloc(size));
+	if (size > SIZE_MAX - alignment - MMAP_THRESHOLD)
+		return (NULL);
+	STAT(stat_malloc(stat_ops(), stat_bin(size), 1));
+
+	if (size >= MMAP_THRESHOLD)
+		bp = mmap_malloc(size, alignment);
+	else {
+		HOME_LOCK();
+#if MM_THREADS
+		remote_drain();
+#endif
+		bp = alloc_aligned(adjust_size(size), alignment);
+		HEAP_UNLOCK();
+	}
+	PROF_ALLOC(bp, size);
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   The C11 name for mm_memalign().  Allocate a block with at least "size"
+ *   bytes of payload whose address is a multiple of "alignment".  Returns
+ *   the address of this block if the allocation was successful and NULL
+ *   otherwise.
+ */
+void *
+mm_aligned_alloc(size_t alignment, size_t size)
+{
+	return (mm_memalign(alignment, size));
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Allocate a block for an array of "nmemb" elements of "size" bytes each
+ *   and set its payload to zero, unless the array is empty or its size
+ *   overflows.  Memory that is known to be zero already is not written.
+ *   Returns the address of this block if the allocation was successful and
+ *   NULL otherwise.
+ */
+void *
+mm_calloc(size_t nmemb, size_t size)
+{
+	size_t bytes, asize;
+	char *bp, *ftr;
+	bool zeroed;
 
-	if (asize <= oldsize)
-		return (ptr);
+	if (nmemb != 0 && size > SIZE_MAX / nmemb)
+		return (NULL);
+	if ((bytes = nmemb * size) == 0)
+		return (NULL);
 
-	/* If the next block is free, we allocate it*/
-	size_t next_size = GET_SIZE(NEXT_BLKP(ptr));
-	if ((!GET_ALLOC(NEXT_BLKP(ptr))) && ((oldsize + next_size) <= asize)){
-		void* next = NEXT_BLKP(ptr);
-		deleteBlock(next);
-		/*Allocate block to account for new size */
-		PUT(HDRP(ptr), PACK(oldsize + next_size, 1));
-		PUT(FTRP(ptr), PACK(oldsize + next_size, 1));
-		return (ptr);
+	/* A new mapping is always zero. */
+	if (bytes >= MMAP_THRESHOLD) {
+		STAT(stat_malloc(stat_ops(), stat_bin(bytes), 1));
+		bp = mmap_malloc(bytes, ALIGN);
+		PROF_ALLOC(bp, bytes);
+		return (bp);
 	}
 
-	//Get a new bit of free memory when realloc isn't possible on current heap
-	newptr = mm_malloc(MAX(oldsize, asize) * 10);
-
-	if (newptr == NULL){
+	/* Small blocks come from runs and caches, so they are never zero. */
+	asize = adjust_size(bytes);
+	if (asize <= QUICK_MAX) {
+		if ((bp = mm_malloc(bytes)) != NULL)
+			memset(bp, 0, bytes);
+		return (bp);
+	}
+	STAT(stat_malloc(stat_ops(), stat_bin(bytes), 1));
+
+	HOME_LOCK();
+#if MM_THREADS
+	remote_drain();
+#endif
+	bp = heap_calloc(asize, &zeroed);
+	HEAP_UNLOCK();
+	if (bp == NULL)
 		return (NULL);
+	PROF_ALLOC(bp, bytes);
+	if (!zeroed) {
+		memset(bp, 0, bytes);
+		return (bp);
 	}
 
-	//copy data
-	memcpy(newptr, ptr, oldsize);
+	/*
+	 * Only the links and the old footer of a ZEROED block were ever
+	 * written.  The footer is inside the payload if place() didn't split
+	 * the block.
+	 */
+	memset(bp, 0, MIN(bytes, FREE_META));
+	ftr = bp + GET_SIZE(HDRP(bp)) - DSIZE;
+	if (ftr < bp + bytes)
+		PUT(ftr, 0);
+	return (bp);
+}
 
-	mm_free(ptr);
-	return (newptr);
+/*
+ * Requires:
+ *   "out" has room for "n" pointers.
+ *
+ * Effects:
+ *   Allocate up to "n" blocks with at least "size" bytes of payload each
+ *   and store their addresses in "out".  Ordinary blocks are carved from
+ *   as few free blocks as possible under a single acquisition of the heap
+ *   lock.  Returns the number of blocks allocated, which is less than "n"
+ *   only if memory ran out or "size" is zero.
+ */
+size_t
+mm_malloc_batch(size_t size, size_t n, void **out)
+{
+	size_t asize, done = 0, i;
+	void *bp;
+
+	if (size == 0)
+		return (0);
+#if MM_THREADS
+	/* Sizes that the thread cache holds are cheapest one at a time. */
+	if (tcache_class(size) >= 0) {
+		while (done < n && (out[done] = mm_malloc(size)) != NULL)
+			done++;
+		return (done);
+	}
+#endif
+	STAT(stat_malloc(stat_ops(), stat_bin(size), n));
+	if (size >= MMAP_THRESHOLD) {
+		while (done < n && (out[done] = mmap_malloc(size, ALIGN)) != NULL)
+			done++;
+		for (i = 0; i < done; i++)
+			PROF_ALLOC(out[i], size);
+		return (done);
+	}
+
+	HOME_LOCK();
+#if MM_THREADS
+	remote_drain();
+#endif
+	if (size <= SLAB_MAX) {
+		while (done < n && (out[done] = slab_malloc(size)) != NULL)
+			done++;
+		HEAP_UNLOCK();
+		for (i = 0; i < done; i++)
+			PROF_ALLOC(out[i], size);
+		return (done);
+	}
+	asize = adjust_size(size);
+#if MM_QUICKLISTS
+	if (asize <= QUICK_MAX) {
+		while (done < n && (bp = heap->quick_lists[asize / ALIGN - 1]) != NULL) {
+			heap->quick_lists[asize / ALIGN - 1] = *(void **)bp;
+			heap->quick_bytes -= asize;
+			out[done++] = bp;
+		}
+	}
+#endif
+	while (done < n) {
+		/* Prefer one free block that holds the whole rest. */
+		if ((bp = find_fit(asize * (n - done))) == NULL &&
+		    (bp = find_fit(asize)) == NULL &&
+		    (bp = grow_heap(asize * (n - done))) == NULL)
+			break;
+		done += place_batch(bp, asize, n - done, out + done);
+	}
+	HEAP_UNLOCK();
+	for (i = 0; i < done; i++)
+		PROF_ALLOC(out[i], size);
+	return (done);
+}
+
+/*
+ * Requires:
+ *   Every non-NULL pointer in "ptrs" is an allocated block, and no block
+ *   appears twice.
+ *
+ * Effects:
+ *   Free the "n" blocks in "ptrs", skipping NULL pointers.  Blocks that
+ *   would be coalesced are sorted by address, and each group of adjacent
+ *   ones is freed as a single block, so it is coalesced only once.  Other
+ *   blocks are freed as mm_free() would.  The order of "ptrs" is not
+ *   preserved.
+ */
+void
+mm_free_batch(void **ptrs, size_t n)
+{
+	size_t i, j, k = 0, m = 0, size;
+	struct run *run;
+	struct arena *a, *held = NULL;
+	void *bp;
+#if MM_THREADS
+	int class;
+#endif
+
+	/*
+	 * Without the lock, unmap huge blocks and move the blocks to sweep
+	 * to the front, followed by the rest.
+	 */
+	for (i = 0; i < n; i++) {
+		if ((bp = ptrs[i]) == NULL)
+			continue;
+		PROF_FREE(bp);
+		run = slab_run(arena_of(bp), bp);
+		STAT(stat_free(stat_ops(), find_explicit(run != NULL ?
+		    run->size : GET_SIZE(HDRP(bp))), 1));
+		if (run == NULL && GET_MMAPPED(HDRP(bp))) {
+			mmap_free(bp);
+			continue;
+		}
+#if MM_THREADS
+		if (arena_of(bp) == home_arena() &&
+		    (class = tcache_block_class(bp, run)) >= 0) {
+			tcache_put(tcache_get(), class, bp);
+			continue;
+		}
+#endif
+		if (run == NULL && !(MM_QUICKLISTS &&
+		    GET_SIZE(HDRP(bp)) <= QUICK_MAX)) {
+			ptrs[k] = ptrs[m];
+			ptrs[m++] = bp;
+		} else
+			ptrs[k] = bp;
+		k++;
+	}
+	if (k == 0)
+		return;
+	qsort(ptrs, m, sizeof(*ptrs), addr_cmp);
+
+	/*
+	 * Each block is freed into its own arena, which is locked when the
+	 * arena changes.  Sorting puts the blocks of each arena together.
+	 */
+	for (i = m; i < k; i++) {
+		if ((a = arena_of(ptrs[i])) != held) {
+			if (held != NULL)
+				HEAP_UNLOCK();
+			HEAP_LOCK(held = a);
+		}
+		heap_free(ptrs[i]);
+	}
+	for (i = 0; i < m; i = j) {
+		bp = ptrs[i];
+		if ((a = arena_of(bp)) != held) {
+			if (held != NULL)
+				HEAP_UNLOCK();
+			HEAP_LOCK(held = a);
+		}
+		size = GET_SIZE(HDRP(bp));
+		for (j = i + 1; j < m && ptrs[j] == (char *)bp + size; j++)
+			size += GET_SIZE(HDRP(ptrs[j]));
+		PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+		PUT(FTRP(bp), PACK(size, 0));
+		CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+		check_absorb(bp, size);
+		coalesce(bp);
+		heap->frees_since_purge += j - i;
+		if (heap->frees_since_purge >= PURGE_INTERVAL)
+			purge();
+	}
+	HEAP_UNLOCK();
 }
 
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Store the allocator's statistics since the last mm_init() in "*st".
+ *   The per-bin counts of calls are summed over every thread.  Blocks that
+ *   wait in a thread cache or on a quick list count as live.  Returns 0 if
+ *   the allocator keeps statistics and -1, storing zeros, if it was built
+ *   without MM_STATS.
+ */
+int
+mm_get_stats(struct mm_stats *st)
+{
+#if MM_STATS
+#if MM_THREADS
+	struct tcache *tc;
+#endif
+
+	memset(st, 0, sizeof(*st));
+	for (int i = 0; i < NARENAS; i++) {
+		HEAP_LOCK(&arenas[i]);
+#if MM_THREADS
+		if (heap->gen == heap_gen)
+#endif
+			stats_add(st, &heap->stats);
+		HEAP_UNLOCK();
+	}
+#if MM_THREADS
+	pthread_mutex_lock(&stats_lock);
+#endif
+	memcpy(st->mallocs, op_stats.mallocs, sizeof(st->mallocs));
+	memcpy(st->frees, op_stats.frees, sizeof(st->frees));
+#if MM_THREADS
+	for (tc = tcache_list; tc != NULL; tc = tc->next) {
+		if (tc->gen != heap_gen)
+			continue;
+		for (int i = 0; i < NUM; i++) {
+			st->mallocs[i] += __atomic_load_n(&tc->ops.mallocs[i],
+			    __ATOMIC_RELAXED);
+			st->frees[i] += __atomic_load_n(&tc->ops.frees[i],
+			    __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&stats_lock);
+#endif
+	return (0);
+#else
+	memset(st, 0, sizeof(*st));
+	return (-1);
+#endif
+}
 
 /*
- * Helper function
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Turn the sampling heap checker on, if "interval" is nonzero, or off.
+ *   While it is on, every operation on the heap checks the tags, links and
+ *   bin of the blocks it touched, and every "interval" operations the next
+ *   CHECK_SLICE blocks of a walk over the whole heap are checked as well.
+ *   Each failed check calls "fail" with a description and the block, or
+ *   is printed if "fail" is NULL.
+ */
+void
+mm_set_check(unsigned int interval, mm_check_fail_t fail)
+{
+	for (int i = 0; i < NARENAS; i++) {
+		HEAP_LOCK(&arenas[i]);
+		check_interval = interval;
+		check_fail = fail;
+		heap->check_ops = 0;
+		heap->check_cursor = NULL;
+		HEAP_UNLOCK();
+	}
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Sample about one allocation per "rate" bytes for the heap profiler, or
+ *   stop sampling if "rate" is zero.  Blocks sampled before stay in the
+ *   profile until they are freed.  Returns 0, or -1 if the allocator was
+ *   built without MM_PROFILE.
+ */
+int
+mm_set_profile(size_t rate)
+{
+#if MM_PROFILE
+	__atomic_store_n(&prof_rate, rate, __ATOMIC_RELAXED);
+	return (0);
+#else
+	(void)rate;
+	return (-1);
+#endif
+}
+
+/*
+ * Requires:
+ *   "fd" is open for writing.
+ *
+ * Effects:
+ *   Write the profile of the sampled blocks to "fd" in the text format of
+ *   pprof heap profiles: a line per call stack with the count and bytes of
+ *   its live samples and of all of its samples, followed by the memory map
+ *   of the process so that pprof can symbolize the stacks.  Returns 0, or
+ *   -1 if writing failed or the allocator was built without MM_PROFILE.
+ */
+int
+mm_dump_profile(int fd)
+{
+#if MM_PROFILE
+	struct prof_out out;
+	struct prof_bucket *b;
+	size_t live_count = 0, live_bytes = 0, alloc_count = 0, alloc_bytes = 0;
+	ssize_t n;
+	int i, j, maps;
+
+	out.fd = fd;
+	out.error = false;
+	out.len = 0;
+	prof_busy = true;
+	PROF_LOCK();
+	for (i = 0; i < PROF_BUCKETS; i++) {
+		for (b = prof_buckets[i]; b != NULL; b = b->next) {
+			live_count += b->live_count;
+			live_bytes += b->live_bytes;
+			alloc_count += b->alloc_count;
+			alloc_bytes += b->alloc_bytes;
+		}
+	}
+	prof_put(&out, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+	    live_count, live_bytes, alloc_count, alloc_bytes,
+	    MAX(__atomic_load_n(&prof_rate, __ATOMIC_RELAXED), (size_t)1));
+	for (i = 0; i < PROF_BUCKETS; i++) {
+		for (b = prof_buckets[i]; b != NULL; b = b->next) {
+			if (b->alloc_count == 0)
+				continue;
+			prof_put(&out, "%zu: %zu [%zu: %zu] @", b->live_count,
+			    b->live_bytes, b->alloc_count, b->alloc_bytes);
+			for (j = 0; j < b->depth; j++)
+				prof_put(&out, " %p", b->pcs[j]);
+			prof_put(&out, "\n");
+		}
+	}
+	PROF_UNLOCK();
+
+	/* pprof finds the binaries that the stacks point into here. */
+	prof_put(&out, "\nMAPPED_LIBRARIES:\n");
+	if ((maps = open("/proc/self/maps", O_RDONLY)) >= 0) {
+		do {
+			prof_put(&out, "");
+			n = read(maps, out.buf + out.len,
+			    sizeof(out.buf) - out.len - 1);
+			if (n > 0)
+				out.len += n;
+		} while (n > 0);
+		close(maps);
+	}
+	prof_put(&out, NULL);
+	prof_busy = false;
+	return (out.error ? -1 : 0);
+#else
+	(void)fd;
+	return (-1);
+#endif
+}
+
+/*
+ * Requires:
+ *   The arena "a" is locked, and "heap" is "a".
+ *
+ * Effects:
+ *   Set up an empty heap in the arena "a": its free list heads, prologue
+ *   and epilogue and a free block of CHUNKSIZE bytes.  Returns 0 if the
+ *   heap was set up and -1 otherwise.
+ */
+static int
+arena_init(struct arena *a)
+{
+	char* temp;
+
+#if MM_THREADS
+	a->remote_frees = NULL;
+#endif
+	if ((temp = mem_arena_sbrk(a->index, NUM * DSIZE)) == (void*)-1)
+		return (-1);
+	a->free_lists = (struct Node*)temp;
+#if MM_STATS
+	memset(&a->stats, 0, sizeof(a->stats));
+	a->stats.live_bytes = NUM * DSIZE + 4 * WSIZE;
+	a->fit_probes = 0;
+#endif
+	a->bin_map = 0;
+	a->tree_root = NULL;
+	a->frees_since_purge = 0;
+	a->check_ops = 0;
+	a->check_cursor = NULL;
+#if MM_QUICKLISTS
+	memset(a->quick_lists, 0, sizeof(a->quick_lists));
+	a->quick_bytes = 0;
+#endif
+	memset(a->partial_runs, 0, sizeof(a->partial_runs));
+	memset(a->run_map, 0, sizeof(a->run_map));
+#if MM_HUGEPAGES
+	a->chunk_next = NULL;
+	a->chunk_end = NULL;
+	a->idle_runs = NULL;
+#endif
+	for (unsigned int i = 0; i < NUM; i++){
+		struct Node* cur = a->free_lists + i;
+		cur->next = cur;
+		cur->prev = cur;
+	}
+
+	if ((a->heap_listp = mem_arena_sbrk(a->index, 4 * WSIZE)) == (void *)-1)
+		return (-1);
+
+	PUT(a->heap_listp, 0);                            /* Alignment padding */
+	PUT(a->heap_listp + (1 * WSIZE), PACK(DSIZE, ALLOC | PREV_ALLOC)); /* Prologue header */ 
+	PUT(a->heap_listp + (2 * WSIZE), PACK(DSIZE, ALLOC)); /* Prologue footer */ 
+	PUT(a->heap_listp + (3 * WSIZE), PACK(0, ALLOC | PREV_ALLOC)); /* Epilogue header */
+
+	a->heap_listp += (2 * WSIZE);
+	
+	/* Extend the empty heap with a free block of CHUNKSIZE bytes. */
+	if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
+		return (-1);
+#if MM_THREADS
+	a->gen = heap_gen;
+#endif
+	return (0);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Returns the arena whose heap holds "bp", or NULL if "bp" is not in any
+ *   heap, as a mapped block isn't.  Each heap lies within MAX_HEAP bytes
+ *   of its start, so this doesn't have to ask memlib where it ends.
+ */
+static inline struct arena *
+arena_of(void *bp)
+{
+	for (int i = 0; i < num_arenas; i++)
+		if ((uintptr_t)bp - (uintptr_t)arenas[i].lo < MAX_HEAP)
+			return (&arenas[i]);
+	return (NULL);
+}
+
+#if MM_THREADS
+/*
+ * Requires:
+ *   The calling thread holds no arena's lock.
+ *
+ * Effects:
+ *   Lock the arena "a" and make it the arena that "heap" refers to.
+ */
+static inline void
+heap_lock(struct arena *a)
+{
+	pthread_mutex_lock(&a->lock);
+	heap = a;
+}
+
+/*
+ * Requires:
+ *   The calling thread holds no arena's lock.
+ *
+ * Effects:
+ *   Lock the arena "a" like heap_lock() if its lock is free.  Returns
+ *   false, without waiting, if another thread holds it.
+ */
+static inline bool
+heap_trylock(struct arena *a)
+{
+	if (pthread_mutex_trylock(&a->lock) != 0)
+		return (false);
+	heap = a;
+	return (true);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Returns the arena of the NUMA node that the calling thread runs on.
+ *   The node is looked up again every HOME_RECHECK calls, so a thread
+ *   that moves to another node soon follows it.
+ */
+static inline struct arena *
+home_arena(void)
+{
+	if (home == NULL || ++home_ops >= HOME_RECHECK) {
+		home = &arenas[mem_home()];
+		home_ops = 0;
+	}
+	return (home);
+}
+
+/*
+ * Requires:
+ *   The calling thread holds no arena's lock.
+ *
+ * Effects:
+ *   Lock the calling thread's arena, setting up its heap if mm_init()
+ *   has run since it was last used.  A thread whose arena can't be set
+ *   up uses arena 0 instead.
+ */
+static void
+home_lock(void)
+{
+	struct arena *a = home_arena();
+
+	heap_lock(a);
+	if (a->gen != heap_gen && arena_init(a) < 0) {
+		HEAP_UNLOCK();
+		home = &arenas[0];
+		heap_lock(home);
+	}
+}
+#endif
+
+/*
+ * Requires:
+ *   The heap is locked.  "size" is greater than zero.
+ *
+ * Effects:
+ *   Allocate a block with at least "size" bytes of payload.  Returns the
+ *   address of this block if the allocation was successful and NULL
+ *   otherwise.
+ */
+static void *
+heap_malloc(size_t size)
+{
+	size_t asize;      /* Adjusted block size */
+	void *bp;
+
+	/* Small requests are carved from a run of their size class. */
+	if (size <= SLAB_MAX)
+		return (slab_malloc(size));
+
+	/* Adjust block size to include overhead and alignment reqs. */
+	asize = adjust_size(size);
+
+#if MM_QUICKLISTS
+	/* Reuse a block of exactly this size that hasn't been coalesced. */
+	if (asize <= QUICK_MAX && (bp = heap->quick_lists[asize / ALIGN - 1]) != NULL) {
+		heap->quick_lists[asize / ALIGN - 1] = *(void **)bp;
+		heap->quick_bytes -= asize;
+		return (bp);
+	}
+#endif
+
+	/* Search the free list for a fit. */
+	if ((bp = find_fit(asize)) != NULL) {
+		place(bp, asize);
+		return (bp);
+	}
+
+	/* No fit found.  Get more memory and place the block. */
+	if ((bp = grow_heap(asize)) == NULL)
+		return (NULL);
+	place(bp, asize);
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   The heap is locked.  "bp" is the address of an allocated block.
+ *
+ * Effects:
+ *   Free a block.
+ */
+static void
+heap_free(void *bp)
+{
+	struct run *run;
+#if MM_QUICKLISTS
+	size_t size;
+#endif
+
+	/* Objects inside a run go back to that run. */
+	if ((run = slab_run(heap, bp)) != NULL) {
+		slab_free(run, bp);
+		return;
+	}
+
+#if MM_QUICKLISTS
+	/* Small blocks wait on a quick list, still marked allocated. */
+	size = GET_SIZE(HDRP(bp));
+	if (size <= QUICK_MAX) {
+		*(void **)bp = heap->quick_lists[size / ALIGN - 1];
+		heap->quick_lists[size / ALIGN - 1] = bp;
+		if ((heap->quick_bytes += size) > QUICK_LIMIT)
+			quick_flush();
+	} else
+		free_block(bp);
+#else
+	free_block(bp);
+#endif
+
+	/*
+	 * Memory goes back to the OS only every PURGE_INTERVAL frees, so a
+	 * block that is freed and soon reused doesn't pay for page faults.
+	 */
+	if (++heap->frees_since_purge >= PURGE_INTERVAL)
+		purge();
+}
+
+/*
+ * Requires:
+ *   The heap is locked.  "bp" is an ordinary allocated block in the heap.
+ *
+ * Effects:
+ *   Mark the block "bp" free and coalesce it with its neighbors.
+ */
+static void
+free_block(void *bp)
+{
+	size_t size = GET_SIZE(HDRP(bp));
+
+	PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+	PUT(FTRP(bp), PACK(size, 0));
+	CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+	coalesce(bp);
+}
+
+/*
+ * Requires:
+ *   The heap is locked.  "asize" is an adjusted block size larger than
+ *   QUICK_MAX.
+ *
+ * Effects:
+ *   Allocate a block of "asize" bytes like heap_malloc() and set "*zeroed"
+ *   to whether the free block it was placed in was ZEROED.  Returns the
+ *   address of the block or NULL if the allocation failed.
+ */
+static void *
+heap_calloc(size_t asize, bool *zeroed)
+{
+	void *bp;
+
+	if ((bp = find_fit(asize)) == NULL &&
+	    (bp = grow_heap(asize)) == NULL)
+		return (NULL);
+	*zeroed = GET_ZEROED(HDRP(bp)) != 0;
+	place(bp, asize);
+	return (bp);
+}
+
+#if MM_QUICKLISTS
+/*
+ * Requires:
+ *   The heap is locked.
+ *
+ * Effects:
+ *   Empty every quick list, freeing and coalescing its blocks.
+ */
+static void
+quick_flush(void)
+{
+	void *bp, *next;
+
+	for (int i = 0; i < NQUICK; i++) {
+		for (bp = heap->quick_lists[i]; bp != NULL; bp = next) {
+			next = *(void **)bp;
+			free_block(bp);
+		}
+		heap->quick_lists[i] = NULL;
+	}
+	heap->quick_bytes = 0;
+}
+#endif
+
+/*
+ * Requires:
+ *   The heap is locked.  "bp" is an ordinary allocated block in the heap and
+ *   "asize" is an adjusted block size.
+ *
+ * Effects:
+ *   Resize the block "bp" to at least "asize" bytes without copying it to
+ *   another part of the heap, if that is possible.  In order of preference,
+ *   the block shrinks by splitting off its tail, grows into a free next
+ *   block, grows the heap if it is the last block, or slides down into a
+ *   free previous block.  Returns the possibly moved block, or NULL if it
+ *   could not be resized in place.
+ */
+static void *
+heap_realloc(void *bp, size_t asize)
+{
+	size_t oldsize = GET_SIZE(HDRP(bp));
+	size_t avail = oldsize, want, prev_size;
+	void *next = NEXT_BLKP(bp);
+	void *prev;
+
+	if (asize <= oldsize) {
+		split_tail(bp, asize + realloc_headroom(asize, asize));
+		return (bp);
+	}
+	want = asize + realloc_headroom(asize, oldsize);
+
+	/* A block at the top of the heap can grow the heap. */
+	if (!GET_ALLOC(HDRP(next)))
+		avail += GET_SIZE(HDRP(next));
+	if (avail < asize) {
+		if (GET_SIZE(HDRP(GET_ALLOC(HDRP(next)) ? next :
+		    NEXT_BLKP(next))) == 0) {
+			if (extend_heap((want - avail) / WSIZE) == NULL)
+				return (NULL);
+			next = NEXT_BLKP(bp);
+			avail = oldsize + GET_SIZE(HDRP(next));
+		}
+	}
+
+	if (avail >= asize) {
+		deleteBlock(next);
+		PUT(HDRP(bp), PACK(avail, ALLOC | GET_PREV_ALLOC(HDRP(bp))));
+		check_absorb(bp, avail);
+		split_tail(bp, want);
+		return (bp);
+	}
+
+	/* Slide the payload down into a free previous block. */
+	if (GET_PREV_ALLOC(HDRP(bp)))
+		return (NULL);
+	prev = PREV_BLKP(bp);
+	prev_size = GET_SIZE(HDRP(prev));
+	if (prev_size + avail < asize)
+		return (NULL);
+	deleteBlock(prev);
+	if (avail != oldsize)
+		deleteBlock(next);
+	memmove(prev, bp, oldsize - WSIZE);
+	PUT(HDRP(prev), PACK(prev_size + avail, ALLOC | GET_PREV_ALLOC(HDRP(prev))));
+	check_absorb(prev, prev_size + avail);
+	split_tail(prev, want);
+	return (prev);
+}
+
+/*
+ * Requires:
+ *   "asize" is the adjusted size a block is being resized to and "oldsize"
+ *   is its current size.
+ *
+ * Effects:
+ *   Returns the number of extra bytes to give a block that is resized.  The
+ *   headroom expects the block to grow again by as much as it just did,
+ *   and it is at least a quarter of "asize" and at most HEADROOM_MAX bytes.
+ *   A block that isn't growing needs none beyond the quarter, which then
+ *   only decides how much of a shrinking block is worth splitting off.
+ */
+static size_t
+realloc_headroom(size_t asize, size_t oldsize)
+{
+	size_t headroom = asize / 4;
+
+	if (asize > oldsize && asize - oldsize > headroom)
+		headroom = asize - oldsize;
+	if (headroom > HEADROOM_MAX)
+		headroom = HEADROOM_MAX;
+	return (ALIGN * (headroom / ALIGN));
+}
+
+/*
+ * Requires:
+ *   The heap is locked.  "bp" is an allocated block whose header is up to
+ *   date, although the next block's PREV_ALLOC bit may not be.
+ *
+ * Effects:
+ *   Shrink the block "bp" to "keep" bytes, rounded up to ALIGN, if the rest
+ *   of it is large enough to be a free block, and free that tail.
+ */
+static void
+split_tail(void *bp, size_t keep)
+{
+	size_t csize = GET_SIZE(HDRP(bp));
+	void *tail;
+
+	/* A block that absorbed a neighbor is at its largest here. */
+	STAT(heap->stats.peak_live_bytes = MAX(heap->stats.peak_live_bytes,
+	    heap->stats.live_bytes));
+	keep = ALIGN * ((keep + ALIGN - 1) / ALIGN);
+	if (keep >= csize || csize - keep < 2 * DSIZE) {
+		SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+		return;
+	}
+	STAT(heap->stats.splits[find_explicit(csize)]++);
+	PUT(HDRP(bp), PACK(keep, ALLOC | GET_PREV_ALLOC(HDRP(bp))));
+	tail = NEXT_BLKP(bp);
+	PUT(HDRP(tail), PACK(csize - keep, PREV_ALLOC));
+	PUT(FTRP(tail), PACK(csize - keep, 0));
+	CLR_PREV_ALLOC(HDRP(NEXT_BLKP(tail)));
+	coalesce(tail);
+}
+
+/*
+ * Requires:
+ *   "size" is at least MMAP_THRESHOLD.  "align" is a power of two that is a
+ *   multiple of ALIGN.
+ *
+ * Effects:
+ *   Allocate a block with at least "size" bytes of payload, aligned to
+ *   "align" bytes, in a mapping of its own.  The word before the block's
+ *   header holds the start of the mapping.  The header has the MMAPPED bit
+ *   set and records the usable size from that word to the end of the
+ *   mapping.  Returns the block or NULL if the mapping failed.
+ */
+static void *
+mmap_malloc(size_t size, size_t align)
+{
+	char *area, *bp;
+
+	if ((area = mem_map(size + DSIZE + (align - ALIGN))) == NULL)
+		return (NULL);
+	bp = (char *)(((uintptr_t)area + DSIZE + align - 1) &
+	    ~(uintptr_t)(align - 1));
+	PUT(bp - DSIZE, (uintptr_t)area);
+	PUT(HDRP(bp), PACK(mem_mapsize(area) - (bp - DSIZE - area),
+	    ALLOC | MMAPPED));
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   "bp" is a mapped block.  "size" is at least MMAP_THRESHOLD.
+ *
+ * Effects:
+ *   Resize the mapping of "bp" to hold at least "size" bytes of payload,
+ *   letting the kernel move its pages instead of copying them.  Returns the
+ *   possibly moved block, or NULL, leaving "bp" intact, if the mapping
+ *   could not be resized.  The block keeps its offset in the mapping, so
+ *   a block aligned to at most the page size stays aligned when it moves.
+ */
+static void *
+mmap_realloc(void *bp, size_t size)
+{
+	char *area = (char *)GET((char *)bp - DSIZE);
+	size_t lead = (char *)bp - DSIZE - area;
+
+	if (size + DSIZE <= GET_SIZE(HDRP(bp)) &&
+	    size + DSIZE + mem_pagesize() > GET_SIZE(HDRP(bp)))
+		return (bp);
+	if ((area = mem_remap(area, lead + size + DSIZE)) == NULL)
+		return (NULL);
+	bp = area + lead + DSIZE;
+	PUT((char *)bp - DSIZE, (uintptr_t)area);
+	PUT(HDRP(bp), PACK(mem_mapsize(area) - lead, ALLOC | MMAPPED));
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   "bp" is a mapped block.
+ *
+ * Effects:
+ *   Unmap the block "bp".
+ */
+static void
+mmap_free(void *bp)
+{
+	mem_unmap((void *)GET((char *)bp - DSIZE));
+}
+
+/*
+ * Requires:
+ *   The heap is locked.
+ *
+ * Effects:
+ *   Give memory held by large free blocks back to the OS.  A free block at
+ *   the top of the heap is trimmed to TRIM_KEEP bytes, or with MM_HUGEPAGES
+ *   to the first huge page boundary past that.  Every other free
+ *   block of at least RELEASE_THRESHOLD bytes keeps its size, but the whole
+ *   pages between its links and its footer are released.
+ */
+static void
+purge(void)
+{
+	struct Node *bp;
+	void *last;
+	size_t size, keep;
+
+	heap->frees_since_purge = 0;
+#if MM_QUICKLISTS
+	quick_flush();
+#endif
+	last = (char *)mem_arena_hi(heap->index) + 1;
+	if (!GET_PREV_ALLOC(HDRP(last))) {
+		bp = (struct Node *)PREV_BLKP(last);
+		size = GET_SIZE(HDRP(bp));
+		keep = TRIM_KEEP + HUGE_SLACK((char *)bp + TRIM_KEEP);
+		if (size >= TRIM_THRESHOLD && size >= keep + mem_releasesize() &&
+		    mem_arena_sbrk(heap->index, -(intptr_t)(size - keep)) !=
+		    (void *)-1) {
+			STAT(heap->stats.live_bytes -= size - keep);
+			check_absorb(bp, size);
+			deleteBlock(bp);
+			PUT(HDRP(bp), PACK(keep, GET_PREV_ALLOC(HDRP(bp)) |
+			    GET_ZEROED(HDRP(bp))));
+			PUT(FTRP(bp), PACK(keep, 0));
+			PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC)); /* New epilogue header */
+			insertBlock(bp);
+		}
+	}
+
+	tree_release(heap->tree_root);
+}
+
+/*
+ * Requires:
+ *   The heap is locked.  "t" is a subtree of TREE_BIN.
+ *
+ * Effects:
+ *   Release the whole pages between the links and the footer of every free
+ *   block in "t" that is at least RELEASE_THRESHOLD bytes and mark those
+ *   blocks ZEROED.  Subtrees that only hold smaller blocks are skipped, and
+ *   so are blocks that are already ZEROED.
+ */
+static void
+tree_release(struct TreeNode *t)
+{
+	size_t size;
+
+	char *lo, *hi;
+	uintptr_t page = mem_releasesize();
+
+	for (; t != NULL; t = t->right) {
+		size = GET_SIZE(HDRP(t));
+		if (size < RELEASE_THRESHOLD)
+			continue;
+		tree_release(t->left);
+		if (GET_ZEROED(HDRP(t)))
+			continue;
+
+		/*
+		 * Released pages read back as zero, so zeroing the partial
+		 * pages at either end makes the whole block known to be zero.
+		 */
+		lo = (char *)t + FREE_META;
+		hi = FTRP(t);
+		if (mem_release(lo, hi - lo) == 0)
+			continue;
+		memset(lo, 0, -(uintptr_t)lo & (page - 1));
+		memset((char *)((uintptr_t)hi & ~(page - 1)), 0,
+		    (uintptr_t)hi & (page - 1));
+		GET(HDRP(t)) |= ZEROED;
+	}
+}
+
+/*
+ * Requires:
+ *   "ptr" is either the address of an allocated block or NULL.
+ *
+ * Effects:
+ *   Reallocates the block "ptr" to a block with at least "size" bytes of
+ *   payload, unless "size" is zero.  If "size" is zero, frees the block
+ *   "ptr" and returns NULL.  If the block "ptr" is already a block with at
+ *   least "size" bytes of payload, then "ptr" may optionally be returned.
+ *   Otherwise, a new block is allocated and the contents of the old block
+ *   "ptr" are copied to that new block.  Returns the address of this new
+ *   block if the allocation was successful and NULL otherwise.
+ */
+void *
+mm_realloc(void *ptr, size_t size)
+{
+	
+	size_t oldsize;
+	void *newptr;
+	size_t asize;
+	struct run *run;
+
+	/* If size == 0 then this is just free, and we return NULL. */
+	if (size == 0) {
+		mm_free(ptr);
+		return (NULL);
+	}
+
+	/* If oldptr is NULL, then this is just malloc. */
+	if (ptr == NULL)
+		return (mm_malloc(size));
+
+	/*
+	 * An object in a run can stay put if the new size maps to the same
+	 * size class; otherwise it always moves.
+	 */
+	if ((run = slab_run(arena_of(ptr), ptr)) != NULL) {
+		if (size <= run->size && size > run->size - ALIGN)
+			return (ptr);
+		if ((newptr = malloc_block(size)) == NULL)
+			return (NULL);
+		memcpy(newptr, ptr, size < run->size ? size : run->size);
+		PROF_ALLOC(newptr, size);
+		mm_free(ptr);
+		return (newptr);
+	}
+
+	/*
+	 * A mapped block that stays huge is resized by remapping its pages
+	 * instead of copying them.
+	 */
+	if (GET_MMAPPED(HDRP(ptr))) {
+		if (size >= MMAP_THRESHOLD) {
+			newptr = mmap_realloc(ptr, size);
+			PROF_MOVE(ptr, newptr, size);
+			return (newptr);
+		}
+		if ((newptr = malloc_block(size)) == NULL)
+			return (NULL);
+		memcpy(newptr, ptr, size);
+		PROF_ALLOC(newptr, size);
+		PROF_FREE(ptr);
+		STAT(stat_free(stat_ops(), TREE_BIN, 1));
+		mmap_free(ptr);
+		return (newptr);
+	}
+
+	/* A block that becomes huge moves into a mapping of its own. */
+	oldsize = GET_SIZE(HDRP(ptr));
+	if (size >= MMAP_THRESHOLD) {
+		STAT(stat_malloc(stat_ops(), stat_bin(size), 1));
+		if ((newptr = mmap_malloc(size, ALIGN)) == NULL)
+			return (NULL);
+		memcpy(newptr, ptr, oldsize - WSIZE);
+		PROF_ALLOC(newptr, size);
+		mm_free(ptr);
+		return (newptr);
+	}
+
+	/* A block that becomes small moves into a run. */
+	if (size <= SLAB_MAX) {
+		if ((newptr = malloc_block(size)) == NULL)
+			return (NULL);
+		memcpy(newptr, ptr, MIN(size, oldsize - WSIZE));
+		PROF_ALLOC(newptr, size);
+		mm_free(ptr);
+		return (newptr);
+	}
+
+	/* Resize the block where it is, if its neighbors allow it. */
+	asize = adjust_size(size);
+	HEAP_LOCK(arena_of(ptr));
+	newptr = heap_realloc(ptr, asize);
+	HEAP_UNLOCK();
+	if (newptr != NULL) {
+		PROF_MOVE(ptr, newptr, size);
+		return (newptr);
+	}
+
+	/*
+	 * Otherwise move the block, leaving some headroom so that a block
+	 * that keeps growing doesn't have to move every time.
+	 */
+	if ((newptr = malloc_block(size + realloc_headroom(asize, oldsize))) == NULL)
+		return (NULL);
+	memcpy(newptr, ptr, oldsize - WSIZE);
+	PROF_ALLOC(newptr, size);
+	mm_free(ptr);
+	return (newptr);
+}
+
+
+/*
+ * Helper function
+ */
+
+/*
+ * Requires: 
+ * "size" is the size of the block being entered into the free list
+ * 
+ * Effects:
+ * 	Returns the number of the free_lists that it needs to be entered into.
+ * 	Sizes are split into BIN_SUBS bins per power of two, so the bin is
+ * 	computed from the position of the leading bit and the BIN_SUB_BITS
+ * 	bits that follow it.  With MM_BINS, the bin is looked up in the
+ * 	generated table.  Every block in bin i is at least as large as
+ * 	every block in bin i - 1.
+ */
+static int
+find_explicit(size_t size)
+{
+#ifdef MM_BINS
+	if (size >= BIN_TABLE_MAX)
+		return (TREE_BIN);
+	return (bin_table[size / ALIGN]);
+#else
+	int lg, bin;
+
+	if (size < MINBIN_SIZE)
+		return (0);
+	lg = LOG2(size);
+	bin = ((lg - LOG2(MINBIN_SIZE)) << BIN_SUB_BITS) +
+	    (int)((size >> (lg - BIN_SUB_BITS)) & (BIN_SUBS - 1));
+	return (bin < NUM ? bin : NUM - 1);
+#endif
+}
+
+
+/*
+ * Requires:
+ *   "size" is greater than zero.
+ *
+ * Effects:
+ *   Returns the size of the block needed for a payload of "size" bytes: the
+ *   payload plus the header, rounded up to ALIGN, and no smaller than the
+ *   minimum block size that can hold a free block's links and footer.
+ */
+static size_t
+adjust_size(size_t size)
+{
+	if (size <= 2 * DSIZE - WSIZE)
+		return (2 * DSIZE);
+	return (ALIGN * ((size + WSIZE + (ALIGN - 1)) / ALIGN));
+}
+
+/*
+ * Requires:
+ *   The heap is locked.  "align" is a power of two that is a multiple of
+ *   ALIGN.
+ *
+ * Effects:
+ *   Allocate a block of "asize" bytes whose address is a multiple of
+ *   "align".  Any slack in front of the block is split off as a free block.
+ *   Returns the address of the block or NULL if the heap could not be
+ *   extended.
+ */
+static void *
+alloc_aligned(size_t asize, size_t align)
+{
+	size_t csize, lead;
+	size_t search = asize + align + 2 * DSIZE;
+	char *bp, *abp;
+
+	if ((bp = find_fit(search)) == NULL &&
+	    (bp = grow_heap(search)) == NULL)
+		return (NULL);
+
+	/* The leading slack must be empty or a valid free block. */
+	abp = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+	if (abp != bp && (size_t)(abp - bp) < 2 * DSIZE)
+		abp += align;
+	if (abp != bp) {
+		csize = GET_SIZE(HDRP(bp));
+		lead = abp - bp;
+		STAT(heap->stats.splits[find_explicit(csize)]++);
+		deleteBlock(bp);
+		PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp))));
+		PUT(FTRP(bp), PACK(lead, 0));
+		insertBlock(bp);
+		PUT(HDRP(abp), PACK(csize - lead, 0));
+		PUT(FTRP(abp), PACK(csize - lead, 0));
+		insertBlock(abp);
+	}
+	place(abp, asize);
+	return (abp);
+}
+
+/*
+ * Requires:
+ *   "bp" is a pointer returned by mm_malloc() or mm_realloc(), and "a" is
+ *   arena_of(bp).
+ *
+ * Effects:
+ *   Returns the run that contains the object "bp" or NULL if "bp" is an
+ *   ordinary block.
+ */
+static struct run *
+slab_run(struct arena *a, void *bp)
+{
+	uintptr_t page;
+
+	if (a == NULL)
+		return (NULL);
+	page = RUN_PAGE(a, bp);
+	if ((a->run_map[page / RUNMAP_BITS] & (1UL << (page % RUNMAP_BITS))) == 0)
+		return (NULL);
+	return (RUN_OF(bp));
+}
+
+/*
+ * Requires:
+ *   "size" is between 1 and SLAB_MAX.
+ *
+ * Effects:
+ *   Allocate an object of at least "size" bytes from a run of its size
+ *   class, starting a new run if every run of that class is full.  Returns
+ *   the address of the object or NULL if no run could be allocated.
+ */
+static void *
+slab_malloc(size_t size)
+{
+	struct run *run;
+	uintptr_t page;
+	void *bp;
+	int class = (size - 1) / ALIGN;
+
+	if ((run = heap->partial_runs[class]) == NULL) {
+		/*
+		 * A run is an ordinary allocated block, so the object area
+		 * ends where the next block's header begins.
+		 */
+		if ((run = run_alloc()) == NULL)
+			return (NULL);
+		run->next = NULL;
+		run->prev = NULL;
+		run->free = NULL;
+		run->bump = (char *)run + RUN_HDRSIZE;
+		run->end = (char *)run + RUNSIZE - WSIZE;
+		run->size = (class + 1) * ALIGN;
+		run->nused = 0;
+		run->nobjs = (run->end - run->bump) / run->size;
+		page = RUN_PAGE(heap, run);
+		heap->run_map[page / RUNMAP_BITS] |= 1UL << (page % RUNMAP_BITS);
+		heap->partial_runs[class] = run;
+	}
+
+	/* Prefer recycled objects; they are more likely to be in cache. */
+	if (run->free != NULL) {
+		bp = run->free;
+		run->free = *(void **)bp;
+	} else {
+		bp = run->bump;
+		run->bump += run->size;
+	}
+
+	/* A full run leaves the partial list until an object is freed. */
+	if (++run->nused == run->nobjs) {
+		heap->partial_runs[class] = run->next;
+		if (run->next != NULL)
+			run->next->prev = NULL;
+		run->next = NULL;
+	}
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   "bp" is an allocated object inside the run "run".
+ *
+ * Effects:
+ *   Return the object "bp" to its run.  A run that becomes empty is freed
+ *   unless it is the only partially used run of its class.
+ */
+static void
+slab_free(struct run *run, void *bp)
+{
+	uintptr_t page;
+	int class = run->size / ALIGN - 1;
+
+	if (check_interval != 0)
+		checkobject(run, bp);
+	*(void **)bp = run->free;
+	run->free = bp;
+
+	/* A previously full run rejoins the partial list. */
+	if (run->nused-- == run->nobjs) {
+		run->prev = NULL;
+		run->next = heap->partial_runs[class];
+		if (run->next != NULL)
+			run->next->prev = run;
+		heap->partial_runs[class] = run;
+	}
+
+	if (run->nused == 0 && (run->prev != NULL || run->next != NULL)) {
+		if (run->prev != NULL)
+			run->prev->next = run->next;
+		else
+			heap->partial_runs[class] = run->next;
+		if (run->next != NULL)
+			run->next->prev = run->prev;
+		page = RUN_PAGE(heap, run);
+		heap->run_map[page / RUNMAP_BITS] &= ~(1UL << (page % RUNMAP_BITS));
+#if MM_HUGEPAGES
+		run->next = heap->idle_runs;
+		heap->idle_runs = run;
+#else
+		heap_free(run);
+#endif
+	}
+}
+
+/*
+ * Requires:
+ *   The heap is locked.
+ *
+ * Effects:
+ *   Allocate the RUNSIZE-aligned block of a new run.  With MM_HUGEPAGES,
+ *   it is an idle run or the next run of a chunk, and a new chunk is only
+ *   allocated once the newest one is used up.  Returns the run or NULL if
+ *   the heap could not be extended.
+ */
+static struct run *
+run_alloc(void)
+{
+#if MM_HUGEPAGES
+	struct run *run;
+	char *chunk;
+
+	if ((run = heap->idle_runs) != NULL) {
+		heap->idle_runs = run->next;
+		return (run);
+	}
+	if (heap->chunk_next == heap->chunk_end) {
+		/*
+		 * The last run ends where the next block's header begins,
+		 * like a run of its own; the others give up their last word.
+		 */
+		if ((chunk = alloc_aligned(RUN_CHUNK, RUN_CHUNK)) == NULL)
+			return (NULL);
+		heap->chunk_next = chunk;
+		heap->chunk_end = chunk + RUN_CHUNK;
+	}
+	run = (struct run *)heap->chunk_next;
+	heap->chunk_next += RUNSIZE;
+	return (run);
+#else
+	return (alloc_aligned(RUNSIZE, RUNSIZE));
+#endif
+}
+
+#if MM_THREADS
+/*
+ * Requires:
+ *   "size" is greater than zero.
+ *
+ * Effects:
+ *   Returns the thread cache class that serves requests of "size" bytes or
+ *   -1 if such requests bypass the cache.
+ */
+static int
+tcache_class(size_t size)
+{
+	size_t asize;
+
+	if (size <= SLAB_MAX)
+		return ((size - 1) / ALIGN);
+	asize = adjust_size(size);
+	return (asize <= TCACHE_MAX ? (int)(asize / ALIGN) - 1 : -1);
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of an allocated block or run object in the heap,
+ *   and "run" is the run it is in, if any.
+ *
+ * Effects:
+ *   Returns the thread cache class that "bp" can be cached under or -1 if
+ *   it must go straight back to the heap.  Ordinary blocks of at most
+ *   SLAB_MAX bytes have no class because those sizes belong to runs.
+ */
+static int
+tcache_block_class(void *bp, struct run *run)
+{
+	size_t size;
+
+	if (run != NULL)
+		return (run->size / ALIGN - 1);
+	size = GET_SIZE(HDRP(bp));
+	if (size <= SLAB_MAX || size > TCACHE_MAX)
+		return (-1);
+	return (size / ALIGN - 1);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Returns the calling thread's cache, emptying it first if it belongs to
+ *   a heap that has since been reinitialized.
+ */
+static struct tcache *
+tcache_get(void)
+{
+	struct tcache *tc = &tcache;
+
+	if (tc->gen != heap_gen) {
+		memset(tc->count, 0, sizeof(tc->count));
+		memset(tc->head, 0, sizeof(tc->head));
+#if MM_STATS
+		memset(&tc->ops, 0, sizeof(tc->ops));
+#endif
+		tc->gen = heap_gen;
+	}
+	if (!tc->registered) {
+		pthread_once(&tcache_once, tcache_init_key);
+		pthread_setspecific(tcache_key, tc);
+		tc->registered = true;
+#if MM_STATS
+		/* mm_get_stats() adds up the counters of every cache. */
+		pthread_mutex_lock(&stats_lock);
+		tc->prev = NULL;
+		tc->next = tcache_list;
+		if (tcache_list != NULL)
+			tcache_list->prev = tc;
+		tcache_list = tc;
+		pthread_mutex_unlock(&stats_lock);
+#endif
+	}
+	return (tc);
+}
+
+/*
+ * Requires:
+ *   "tc" is tcache_get().  "bp" is an allocated block or run object of
+ *   thread cache class "class".
+ *
+ * Effects:
+ *   Keep the block "bp" in the calling thread's cache, first flushing some
+ *   blocks of its class back to the heap if the cache is full.
+ */
+static void
+tcache_put(struct tcache *tc, int class, void *bp)
+{
+	if (tc->count[class] == TCACHE_COUNT)
+		tcache_flush(tc, class, TCACHE_BATCH);
+	*(void **)bp = tc->head[class];
+	tc->head[class] = bp;
+	tc->count[class]++;
+}
+
+/*
+ * Requires:
+ *   The heap is locked.  "class" is tcache_class(size) and
+ *   tc->head[class] is empty.
+ *
+ * Effects:
+ *   Allocate a block for a request of "size" bytes, and move up to
+ *   TCACHE_BATCH - 1 more blocks of the same class into the cache, taking
+ *   them only from memory that is already free.  Returns the block or NULL
+ *   if the allocation failed.
+ */
+static void *
+tcache_refill(struct tcache *tc, int class, size_t size)
+{
+	void *bp, *extra;
+	size_t asize = (class + 1) * ALIGN;
+	unsigned int n, batch;
+
+	if ((bp = heap_malloc(size)) == NULL)
+		return (NULL);
+	batch = MAX(1, TCACHE_BATCH_BYTES / asize);
+	if (batch > TCACHE_BATCH)
+		batch = TCACHE_BATCH;
+	for (n = 1; n < batch; n++) {
+		if (size <= SLAB_MAX) {
+			if (heap->partial_runs[class] == NULL)
+				break;
+			extra = slab_malloc(size);
+		} else {
+			if ((extra = find_fit(asize)) == NULL)
+				break;
+			place(extra, asize);
+			/* place() may leave a bigger block of another class. */
+			if (GET_SIZE(HDRP(extra)) != asize) {
+				heap_free(extra);
+				break;
+			}
+		}
+		*(void **)extra = tc->head[class];
+		tc->head[class] = extra;
+		tc->count[class]++;
+	}
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   The heap is not locked by the calling thread.
+ *
+ * Effects:
+ *   Return up to "n" blocks of class "class" from the cache to their
+ *   arenas.  The blocks go in chains of consecutive blocks of the same
+ *   arena, which are all of them unless the thread has moved to another
+ *   node.  If an arena's lock is busy, its chain is handed over on the
+ *   arena's remote free stack instead.
+ */
+static void
+tcache_flush(struct tcache *tc, int class, unsigned int n)
+{
+	void *bp, *next, *first, *last;
+	struct arena *a;
+	unsigned int k;
+
+	while (n > 0 && (first = tc->head[class]) != NULL) {
+		a = arena_of(first);
+		for (last = first, k = 1; k < n && *(void **)last != NULL &&
+		    arena_of(*(void **)last) == a; last = *(void **)last)
+			k++;
+		tc->head[class] = *(void **)last;
+		tc->count[class] -= k;
+		n -= k;
+		if (!heap_trylock(a)) {
+			remote_push(a, first, last);
+			continue;
+		}
+		for (bp = first; k-- > 0; bp = next) {
+			next = *(void **)bp;
+			heap_free(bp);
+		}
+		HEAP_UNLOCK();
+	}
+}
+
+/*
+ * Requires:
+ *   "first" through "last" is a chain of allocated blocks of the arena
+ *   "a" linked through their first payload word.
+ *
+ * Effects:
+ *   Push the whole chain onto the arena's remote free stack with a single
+ *   compare-and-swap.  The blocks stay marked allocated until they are
+ *   drained.
+ */
+static void
+remote_push(struct arena *a, void *first, void *last)
+{
+	void *head = __atomic_load_n(&a->remote_frees, __ATOMIC_RELAXED);
+
+	do {
+		*(void **)last = head;
+	} while (!__atomic_compare_exchange_n(&a->remote_frees, &head, first,
+	    true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * Requires:
+ *   The heap is locked.
+ *
+ * Effects:
+ *   Take every block off the remote free stack and free it, coalescing
+ *   ordinary blocks with their neighbors.
+ */
+static void
+remote_drain(void)
+{
+	void *bp, *next;
+
+	if (__atomic_load_n(&heap->remote_frees, __ATOMIC_RELAXED) == NULL)
+		return;
+	bp = __atomic_exchange_n(&heap->remote_frees, NULL, __ATOMIC_ACQUIRE);
+	for (; bp != NULL; bp = next) {
+		next = *(void **)bp;
+		heap_free(bp);
+	}
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Create the key whose destructor flushes a thread's cache at exit.
+ */
+static void
+tcache_init_key(void)
+{
+	pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/*
+ * Requires:
+ *   "arg" is the cache of a thread that is exiting.
+ *
+ * Effects:
+ *   Return every block in the cache to the heap.  With MM_STATS, the
+ *   thread's counters are added to those of exited threads.
+ */
+static void
+tcache_destroy(void *arg)
+{
+	struct tcache *tc = arg;
+
+	if (tc->gen == heap_gen) {
+		for (int i = 0; i < NTCACHE; i++)
+			tcache_flush(tc, i, TCACHE_COUNT);
+	}
+#if MM_STATS
+	pthread_mutex_lock(&stats_lock);
+	if (tc->gen == heap_gen) {
+		for (int i = 0; i < NUM; i++) {
+			op_stats.mallocs[i] += tc->ops.mallocs[i];
+			op_stats.frees[i] += tc->ops.frees[i];
+		}
+	}
+	if (tc->prev != NULL)
+		tc->prev->next = tc->next;
+	else
+		tcache_list = tc->next;
+	if (tc->next != NULL)
+		tc->next->prev = tc->prev;
+	pthread_mutex_unlock(&stats_lock);
+#endif
+	tc->registered = false;
+}
+#endif
+
+#if MM_STATS
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Add the heap counters of an arena, "a", to "st".  The peaks of the
+ *   arenas are added up, which overstates the peak of the whole heap if
+ *   the arenas peaked at different times.
+ */
+static void
+stats_add(struct mm_stats *st, const struct mm_stats *a)
+{
+	for (int i = 0; i < NUM; i++) {
+		st->splits[i] += a->splits[i];
+		st->free_bytes[i] += a->free_bytes[i];
+		st->free_blocks[i] += a->free_blocks[i];
+	}
+	for (int i = 0; i < 4; i++)
+		st->coalesces[i] += a->coalesces[i];
+	for (int i = 0; i < MM_STATS_PROBE_BUCKETS; i++)
+		st->probes[i] += a->probes[i];
+	st->extends += a->extends;
+	st->extend_bytes += a->extend_bytes;
+	st->live_bytes += a->live_bytes;
+	st->peak_live_bytes += MAX(a->peak_live_bytes, a->live_bytes);
+}
+
+/*
+ * Requires:
+ *   "size" is greater than zero.
+ *
+ * Effects:
+ *   Returns the bin of the blocks that serve requests of "size" bytes.
+ *   The objects of a run count as blocks of their class's size.
+ */
+static int
+stat_bin(size_t size)
+{
+	if (size >= MMAP_THRESHOLD)
+		return (TREE_BIN);
+	if (size <= SLAB_MAX)
+		return (find_explicit(ALIGN * ((size + ALIGN - 1) / ALIGN)));
+	return (find_explicit(adjust_size(size)));
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Returns the counters of the calls that the calling thread makes: those
+ *   in its cache, or without MM_THREADS, the only ones.
+ */
+static struct op_stats *
+stat_ops(void)
+{
+#if MM_THREADS
+	return (&tcache_get()->ops);
+#else
+	return (&op_stats);
+#endif
+}
+
+/*
+ * Requires:
+ *   "ops" is stat_ops() of the calling thread.
+ *
+ * Effects:
+ *   Count "n" requests for blocks in bin "bin".  Only the calling thread
+ *   writes its counters, and mm_get_stats() adds them up.
+ */
+static inline void
+stat_malloc(struct op_stats *ops, int bin, unsigned long n)
+{
+	ops->mallocs[bin] += n;
+}
+
+/*
+ * Requires:
+ *   "ops" is stat_ops() of the calling thread.
+ *
+ * Effects:
+ *   Count "n" frees of blocks in bin "bin".
+ */
+static inline void
+stat_free(struct op_stats *ops, int bin, unsigned long n)
+{
+	ops->frees[bin] += n;
+}
+
+/*
+ * Requires:
+ *   The heap is locked.
+ *
+ * Effects:
+ *   Add the search of the free lists that just ended, which examined
+ *   "fit_probes" blocks, to the probe histogram and start a new one.
+ */
+static void
+stat_probes(void)
+{
+	int bucket = 0;
+
+	if (heap->fit_probes > 0)
+		bucket = MIN(1 + LOG2(heap->fit_probes), MM_STATS_PROBE_BUCKETS - 1);
+	heap->stats.probes[bucket]++;
+	heap->fit_probes = 0;
+}
+#endif
+
+#if MM_PROFILE
+/*
+ * Requires:
+ *   "bp" is a block of "size" bytes that was just allocated, and the
+ *   calling thread's countdown just fell to zero or below.
+ *
+ * Effects:
+ *   Start a new interval and, unless the countdown only now got its first
+ *   interval, record "bp" and the stack that allocated it.  The stack is
+ *   captured before the profiler is locked, since backtrace() may itself
+ *   call malloc().
+ */
+static void
+prof_sample(void *bp, size_t size)
+{
+	struct prof_sample *sample;
+	struct prof_bucket *bucket;
+	void *pcs[PROF_DEPTH + PROF_SKIP];
+	size_t rate = __atomic_load_n(&prof_rate, __ATOMIC_RELAXED);
+	int depth;
+
+	if (rate == 0 || prof_busy) {
+		prof_countdown = PROF_IDLE;
+		prof_armed = false;
+		return;
+	}
+	prof_countdown = prof_interval(rate);
+	if (!prof_armed) {
+		prof_armed = true;
+		return;
+	}
+
+	prof_busy = true;
+	depth = backtrace(pcs, PROF_DEPTH + PROF_SKIP);
+	PROF_LOCK();
+	if (prof_used + 1 > (prof_mask + 1) / 2 && !prof_grow())
+		goto out;
+	if ((bucket = prof_bucket(pcs + MIN(depth, PROF_SKIP),
+	    depth - MIN(depth, PROF_SKIP))) == NULL)
+		goto out;
+	if ((sample = prof_find(bp))->addr != 0)
+		prof_remove(sample);
+	sample = prof_find(bp);
+	sample->addr = (uintptr_t)bp;
+	sample->size = size;
+	sample->bucket = bucket;
+	prof_used++;
+	__atomic_store_n(&prof_hints[PROF_HINT(bp)],
+	    prof_hints[PROF_HINT(bp)] + 1, __ATOMIC_RELAXED);
+	bucket->live_count++;
+	bucket->live_bytes += size;
+	bucket->alloc_count++;
+	bucket->alloc_bytes += size;
+out:
+	PROF_UNLOCK();
+	prof_busy = false;
+}
+
+/*
+ * Requires:
+ *   "bp" is an allocated block that is about to be freed.
+ *
+ * Effects:
+ *   If "bp" was sampled, remove it from the live blocks of the profile.
+ */
+static void
+prof_free(void *bp)
+{
+	struct prof_sample *sample;
+
+	PROF_LOCK();
+	if (prof_samples != NULL && (sample = prof_find(bp))->addr != 0)
+		prof_remove(sample);
+	PROF_UNLOCK();
+}
+
+/*
+ * Requires:
+ *   "bp" was just resized without mm_malloc() or mm_free(), becoming
+ *   "newbp" with "size" bytes.
+ *
+ * Effects:
+ *   If "bp" was sampled, the sample moves to "newbp" and takes its size.
+ */
+static void
+prof_move(void *bp, void *newbp, size_t size)
+{
+	struct prof_sample *sample;
+	struct prof_bucket *bucket;
+
+	PROF_LOCK();
+	if (prof_samples != NULL && (sample = prof_find(bp))->addr != 0) {
+		bucket = sample->bucket;
+		prof_remove(sample);
+		if ((sample = prof_find(newbp))->addr != 0)
+			prof_remove(sample);
+		sample = prof_find(newbp);
+		sample->addr = (uintptr_t)newbp;
+		sample->size = size;
+		sample->bucket = bucket;
+		prof_used++;
+		__atomic_store_n(&prof_hints[PROF_HINT(newbp)],
+		    prof_hints[PROF_HINT(newbp)] + 1, __ATOMIC_RELAXED);
+		bucket->live_count++;
+		bucket->live_bytes += size;
+	}
+	PROF_UNLOCK();
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Forget every sample, since mm_init() discards the blocks.  Stacks are
+ *   kept, with their counts cleared.
+ */
+static void
+prof_reset(void)
+{
+	struct prof_bucket *b;
+
+	PROF_LOCK();
+	if (prof_samples != NULL)
+		memset(prof_samples, 0, (prof_mask + 1) * sizeof(*prof_samples));
+	prof_used = 0;
+	memset(prof_hints, 0, sizeof(prof_hints));
+	for (int i = 0; i < PROF_BUCKETS; i++) {
+		for (b = prof_buckets[i]; b != NULL; b = b->next) {
+			b->live_count = b->live_bytes = 0;
+			b->alloc_count = b->alloc_bytes = 0;
+		}
+	}
+	PROF_UNLOCK();
+}
+
+/*
+ * Requires:
+ *   "rate" is greater than zero.
+ *
+ * Effects:
+ *   Returns the bytes until the next sample, drawn from an exponential
+ *   distribution with a mean of "rate" bytes.
+ */
+static long
+prof_interval(size_t rate)
+{
+	double u;
+
+	if (prof_rng == 0)
+		prof_rng = ((uintptr_t)&prof_rng * 0x9E3779B97F4A7C15ULL) | 1;
+	prof_rng ^= prof_rng >> 12;
+	prof_rng ^= prof_rng << 25;
+	prof_rng ^= prof_rng >> 27;
+	u = (((prof_rng * 0x2545F4914F6CDD1DULL) >> 11) + 1) * 0x1p-53;
+	return ((long)MIN(-log(u) * rate, (double)(LONG_MAX / 2)) + 1);
+}
+
+/*
+ * Requires:
+ *   The profiler is locked.
+ *
+ * Effects:
+ *   Returns the bucket of the "depth"-frame stack "pcs", creating it if
+ *   this is the first sample from that stack, or NULL if memory for it
+ *   could not be mapped.
+ */
+static struct prof_bucket *
+prof_bucket(void **pcs, int depth)
+{
+	struct prof_bucket *b;
+	uintptr_t hash = depth;
+	int i;
+
+	for (i = 0; i < depth; i++)
+		hash = (hash ^ (uintptr_t)pcs[i]) * 0x100000001B3ULL;
+	for (b = prof_buckets[hash % PROF_BUCKETS]; b != NULL; b = b->next) {
+		if (b->hash == hash && b->depth == depth &&
+		    memcmp(b->pcs, pcs, depth * sizeof(*pcs)) == 0)
+			return (b);
+	}
+
+	/* Stacks are never freed, so they are carved from a pool. */
+	if (prof_pool_left < sizeof(*b)) {
+		prof_pool = mmap(NULL, PROF_POOL, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (prof_pool == MAP_FAILED) {
+			prof_pool_left = 0;
+			return (NULL);
+		}
+		prof_pool_left = PROF_POOL;
+	}
+	b = (struct prof_bucket *)prof_pool;
+	prof_pool += sizeof(*b);
+	prof_pool_left -= sizeof(*b);
+	b->hash = hash;
+	b->depth = depth;
+	memcpy(b->pcs, pcs, depth * sizeof(*pcs));
+	b->next = prof_buckets[hash % PROF_BUCKETS];
+	prof_buckets[hash % PROF_BUCKETS] = b;
+	return (b);
+}
+
+/*
+ * Requires:
+ *   The profiler is locked and the sample table exists.
+ *
+ * Effects:
+ *   Returns the slot of the sample table that holds "bp", or the empty
+ *   slot where it would go.  The table is open-addressed with linear
+ *   probing.
+ */
+static struct prof_sample *
+prof_find(void *bp)
+{
+	size_t i = PROF_SLOT(bp, prof_mask);
+
+	while (prof_samples[i].addr != 0 &&
+	    prof_samples[i].addr != (uintptr_t)bp)
+		i = (i + 1) & prof_mask;
+	return (&prof_samples[i]);
+}
+
+/*
+ * Requires:
+ *   The profiler is locked and "sample" is a slot in use.
+ *
+ * Effects:
+ *   Remove the sample from its bucket's live blocks and from the table.
+ *   The samples after it in its probe sequence are shifted back so that
+ *   the table needs no tombstones.
+ */
+static void
+prof_remove(struct prof_sample *sample)
+{
+	size_t i = sample - prof_samples, j, home;
+	unsigned int *hint = &prof_hints[PROF_HINT(sample->addr)];
+
+	sample->bucket->live_count--;
+	sample->bucket->live_bytes -= sample->size;
+	__atomic_store_n(hint, *hint - 1, __ATOMIC_RELAXED);
+	for (j = (i + 1) & prof_mask; prof_samples[j].addr != 0;
+	    j = (j + 1) & prof_mask) {
+		/* A sample can move back to i unless its home is in (i, j]. */
+		home = PROF_SLOT(prof_samples[j].addr, prof_mask);
+		if (((j - home) & prof_mask) >= ((j - i) & prof_mask)) {
+			prof_samples[i] = prof_samples[j];
+			i = j;
+		}
+	}
+	prof_samples[i].addr = 0;
+	prof_used--;
+}
+
+/*
+ * Requires:
+ *   The profiler is locked.
+ *
+ * Effects:
+ *   Create the sample table, or double it.  Its memory is mapped directly
+ *   so that the profiler doesn't change the heap it profiles.  Returns
+ *   false if the memory could not be mapped.
  */
+static bool
+prof_grow(void)
+{
+	struct prof_sample *old = prof_samples, *sample;
+	size_t old_mask = prof_mask;
+	size_t mask = (old == NULL) ? PROF_SAMPLES - 1 : 2 * old_mask + 1;
+	void *p;
+
+	p = mmap(NULL, (mask + 1) * sizeof(*old), PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return (false);
+	prof_samples = p;
+	prof_mask = mask;
+	if (old == NULL)
+		return (true);
+	for (size_t i = 0; i <= old_mask; i++) {
+		if (old[i].addr == 0)
+			continue;
+		sample = prof_find((void *)old[i].addr);
+		*sample = old[i];
+	}
+	munmap(old, (old_mask + 1) * sizeof(*old));
+	return (true);
+}
 
 /*
- * Requires: 
- * "size" is the size of the block being entered into the free list
- * 
+ * Requires:
+ *   "out" was set up by mm_dump_profile().
+ *
  * Effects:
- * 	Returns the number of the free_lists that it needs to be entered into  
+ *   Append formatted text to "out", first writing out the buffer if the
+ *   text may not fit.  A NULL "fmt" only writes out the buffer.
  */
-static int
-find_explicit(size_t size)
+static void
+prof_put(struct prof_out *out, const char *fmt, ...)
 {
-	if (size <= 64){
-		return (0);
+	va_list ap;
+	ssize_t n;
+	size_t done = 0;
+	int len;
+
+	if (fmt == NULL || out->len > sizeof(out->buf) - 256) {
+		while (done < out->len && (n = write(out->fd,
+		    out->buf + done, out->len - done)) > 0)
+			done += n;
+		if (done < out->len)
+			out->error = true;
+		out->len = 0;
 	}
-	else if (size <= 128){
-		return (1);
-	}
-	else if (size <= 256){
-		return (2);
-	}
-	else if (size <= 500){
-		return (3);
-	}
-	else if (size <= 750) {
-        return (4);
-    }
-    else if (size <= 1000) {
-        return (5);
-    }
-    else if (size <= 2000) {
-        return (6);
-    }
-	else if (size <= 3000) {
-        return (7);
-    }
-    else if (size <= 4000) {
-        return (8);
-    }
-    else if (size <= 5000) {
-        return (9);
-    }
-    else if (size <= 6000) {
-        return (10);
-    }
-    else if (size <= 7000) {
-        return (11);
-    }
-    else if (size <= 8000) {
-        return (12);
-    }
-    else if (size <= 9000) {
-        return (13);
-    }
-    else {
-        return (14);
-    }
-
-
+	if (fmt == NULL)
+		return;
+	va_start(ap, fmt);
+	len = vsnprintf(out->buf + out->len, sizeof(out->buf) - out->len, fmt,
+	    ap);
+	va_end(ap);
+	if (len > 0)
+		out->len += MIN((size_t)len, sizeof(out->buf) - out->len - 1);
 }
-
+#endif
 
 /*
  * Requires:
@@ -337,13 +2948,17 @@ static void *
 coalesce(void *bp) 
 {
 	size_t size = GET_SIZE(HDRP(bp));
-	bool prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+	bool prev_alloc = GET_PREV_ALLOC(HDRP(bp));
 	bool next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+	void *prev, *next;
+	uintptr_t zeroed;
 
 	if (prev_alloc && next_alloc) {
 		//if the previous block and next block
 		//are both allocated then just insert there
 		insertBlock((struct Node*)bp);                 			/* Case 1 */
+		STAT(heap->stats.coalesces[0]++);
+		CHECK(bp);
 		return (bp);
 	} else if (prev_alloc && !next_alloc) {
 		//if the next block is free and the
@@ -352,39 +2967,73 @@ coalesce(void *bp)
 		//delete the next block in order to create
 		//a new block of biggger size with the next block
 		//and the current block
-		deleteBlock((struct Node*)NEXT_BLKP(bp));
+		next = NEXT_BLKP(bp);
+		deleteBlock((struct Node*)next);
 		//we increase the size of the block we are packing
 		//and then put that
-		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-		PUT(HDRP(bp), PACK(size, 0));
+		size += GET_SIZE(HDRP(next));
+		zeroed = zero_seam(bp, next);
+		PUT(HDRP(bp), PACK(size, PREV_ALLOC | zeroed));
 		PUT(FTRP(bp), PACK(size, 0));
 		insertBlock((struct Node*)bp);
+		STAT(heap->stats.coalesces[1]++);
 	} else if (!prev_alloc && next_alloc) { 
 		//if the prev block is free and the next
 		//block is allocated then delete the prev
 		//block        								/* Case 3 */
-		size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-		deleteBlock((struct Node*)PREV_BLKP(bp));
+		//a free block's footer holds its size,
+		//so the prev block can be found
+		prev = PREV_BLKP(bp);
+		size += GET_SIZE(HDRP(prev));
+		deleteBlock((struct Node*)prev);
 		PUT(FTRP(bp), PACK(size, 0));
-		PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-		bp = PREV_BLKP(bp);
+		zeroed = zero_seam(prev, bp);
+		bp = prev;
+		PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | zeroed));
 		insertBlock((struct Node*)bp);
+		STAT(heap->stats.coalesces[2]++);
 	} else {                       
 		//if the prev and next blocks are both
 		//free we combine all three blocks           /* Case 4 */
-		deleteBlock((struct Node*)NEXT_BLKP(bp));
-		deleteBlock((struct Node*)PREV_BLKP(bp));
-		size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
-		    GET_SIZE(FTRP(NEXT_BLKP(bp)));
-		PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-		PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
-		bp = PREV_BLKP(bp);
+		prev = PREV_BLKP(bp);
+		next = NEXT_BLKP(bp);
+		deleteBlock((struct Node*)next);
+		deleteBlock((struct Node*)prev);
+		size += GET_SIZE(HDRP(prev)) + GET_SIZE(HDRP(next));
+		PUT(FTRP(next), PACK(size, 0));
+		zeroed = zero_seam(bp, next) ? zero_seam(prev, bp) : 0;
+		bp = prev;
+		PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | zeroed));
 		insertBlock((struct Node*)bp);
+		STAT(heap->stats.coalesces[3]++);
 	}
-	//checkheap(false);
+	check_absorb(bp, size);
+	CHECK(bp);
 	return (bp);
 }
 
+/*
+ * Requires:
+ *   "lower" and "upper" are adjacent free blocks that are being merged,
+ *   and their headers are still intact.
+ *
+ * Effects:
+ *   If both blocks are ZEROED, zero the footer of "lower" and the header
+ *   and links of "upper", so that the merged block is ZEROED too.  Returns
+ *   ZEROED if the merged block is ZEROED and 0 otherwise.
+ */
+static uintptr_t
+zero_seam(void *lower, void *upper)
+{
+	char *lo = FTRP(lower);
+	char *hi = MIN((char *)upper + FREE_META, FTRP(upper));
+
+	if (!GET_ZEROED(HDRP(lower)) || !GET_ZEROED(HDRP(upper)))
+		return (0);
+	memset(lo, 0, hi - lo);
+	return (ZEROED);
+}
+
 /* 
  * Requires:
  *   None.
@@ -397,46 +3046,149 @@ extend_heap(size_t words)
 {
 	size_t size;
 	void *bp;
+	uintptr_t zeroed;
 
 	/* Allocate an even number of words to maintain alignment. */
 	size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-	if ((bp = mem_sbrk(size)) == (void *)-1)  
+	zeroed = mem_is_zero((char *)mem_arena_hi(heap->index) + 1) ? ZEROED : 0;
+	if ((bp = mem_arena_sbrk(heap->index, size)) == (void *)-1)  
 		return (NULL);
-
-	/* Initialize free block header/footer and the epilogue header. */
-	PUT(HDRP(bp), PACK(size, 0));         /* Free block header */
-	PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
-	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+	STAT(heap->stats.extends++);
+	STAT(heap->stats.extend_bytes += size);
+	STAT(heap->stats.live_bytes += size);
+
+	/*
+	 * Initialize free block header/footer and the epilogue header.  The
+	 * old epilogue header becomes the new block's header, so it already
+	 * knows whether the last block is allocated.
+	 */
+	PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | zeroed)); /* Free block header */
+	PUT(FTRP(bp), PACK(size, 0));             /* Free block footer */
+	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC)); /* New epilogue header */
 
 	/* Coalesce if the previous block was free. */
 	return (coalesce(bp));
 }
 
+/*
+ * Requires:
+ *   The heap is locked.  "asize" is a block size that no free block fits.
+ *
+ * Effects:
+ *   Extend the heap so that its last block is a free block of at least
+ *   "asize" bytes, and return that block's address.  A free block already
+ *   at the top of the heap is extended by only the shortfall.  The heap
+ *   also grows by at least 1/GROW_RATIO of its size, up to GROW_MAX bytes,
+ *   so that a heap under sustained growth extends geometrically and calls
+ *   mem_sbrk() less and less often.  With MM_HUGEPAGES, it grows up to
+ *   the next huge page boundary.  Returns NULL if the heap could not be
+ *   extended.
+ */
+static void *
+grow_heap(size_t asize)
+{
+	char *last = (char *)mem_arena_hi(heap->index) + 1;
+	size_t top = 0, need;
+
+	if (!GET_PREV_ALLOC(HDRP(last)))
+		top = GET_SIZE(HDRP(PREV_BLKP(last)));
+	if (top >= asize)
+		return (PREV_BLKP(last));
+	need = MAX(asize - top, MIN(mem_arena_size(heap->index) / GROW_RATIO,
+	    GROW_MAX));
+	need += HUGE_SLACK(last + need);
+	return (extend_heap(need / WSIZE));
+}
+
 /*
  * Requires:
  *   None.
  *
  * Effects:
  *   Find a fit for a block with "asize" bytes.  Returns that block's address
- *   or NULL if no suitable block was found. 
+ *   or NULL if no suitable block was found.  If none is found but blocks are
+ *   waiting on the quick lists, they are coalesced and the search repeated.
  */
 static void *
 find_fit(size_t asize)
+{
+	void *bp = bin_fit(asize);
+
+#if MM_QUICKLISTS
+	if (bp == NULL && heap->quick_bytes > 0) {
+		quick_flush();
+		bp = bin_fit(asize);
+	}
+#endif
+	STAT(stat_probes());
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Find a fit for a block with "asize" bytes in the free lists.  Returns
+ *   that block's address or NULL if no suitable block was found.
+ */
+static void *
+bin_fit(size_t asize)
 {
 	struct Node *bp, *temp;
-    int size = find_explicit(asize);
-    /* find bin helps us find the best free list to start w */
-    for (int i = size; i < NUM; i++) {
-		//iterate through free list
-        temp = free_lists + i;
-        /* once we find a fit, that will be the best fit since seggregated lists are sorted*/
-        for (bp = temp->next; bp != temp; bp = bp->next) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return (bp);
-            }
-        }
-    }
-    return (NULL);
+	unsigned long map;
+	int bin = find_explicit(asize);
+
+	if (bin == TREE_BIN)
+		return (tree_fit(asize));
+
+	/*
+	 * The block's own bin may hold blocks that are smaller than asize,
+	 * so it is the only one that has to be searched.
+	 */
+	if (heap->bin_map & (1UL << bin)) {
+		temp = heap->free_lists + bin;
+		for (bp = temp->next; bp != temp; bp = bp->next) {
+			STAT(heap->fit_probes++);
+			if (asize <= GET_SIZE(HDRP(bp)))
+				return (bp);
+		}
+	}
+
+	/* Any block in a larger non-empty bin fits; take the first one. */
+	map = heap->bin_map & ~((2UL << bin) - 1);
+	if (map == 0)
+		return (NULL);
+	bin = __builtin_ctzl(map);
+	if (bin == TREE_BIN)
+		return (tree_fit(asize));
+	STAT(heap->fit_probes++);
+	return (heap->free_lists[bin].next);
+}
+
+/*
+ * Requires:
+ *   The heap is locked.
+ *
+ * Effects:
+ *   Returns the smallest free block in TREE_BIN that is at least "asize"
+ *   bytes, preferring the lowest address among blocks of that size, or
+ *   NULL if there is none.
+ */
+static void *
+tree_fit(size_t asize)
+{
+	struct TreeNode *t, *best = NULL;
+
+	for (t = heap->tree_root; t != NULL; ) {
+		STAT(heap->fit_probes++);
+		if (GET_SIZE(HDRP(t)) >= asize) {
+			best = t;
+			t = t->left;
+		} else
+			t = t->right;
+	}
+	return (best);
 }
 
 
@@ -454,24 +3206,87 @@ place(void *bp, size_t asize)
 {
 	//gets the size of the header of the block pointer
 	size_t csize = GET_SIZE(HDRP(bp));   
+	uintptr_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	uintptr_t zeroed = GET_ZEROED(HDRP(bp));
+
+	deleteBlock(bp);
 	// if the block requires splitting
-	if ((csize - asize) >= (ALIGN + DSIZE)) {
-		PUT(HDRP(bp), PACK(asize, 1));
-		PUT(FTRP(bp), PACK(asize, 1));
-		deleteBlock(bp);
+	if ((csize - asize) >= (2 * DSIZE)) {
+		STAT(heap->stats.splits[find_explicit(csize)]++);
+		PUT(HDRP(bp), PACK(asize, ALLOC | prev_alloc));
 		bp = NEXT_BLKP(bp);
-		PUT(HDRP(bp), PACK(csize - asize, 0));
+		/* The remainder's tail is part of the old block's tail. */
+		PUT(HDRP(bp), PACK(csize - asize, PREV_ALLOC | zeroed));
 		PUT(FTRP(bp), PACK(csize - asize, 0));
-		struct Node* split = (struct Node *) bp;
-		insertBlock(split);
+		insertBlock(bp);
+	} else {
+		PUT(HDRP(bp), PACK(csize, ALLOC | prev_alloc));
+		SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+	}
+	STAT(heap->stats.peak_live_bytes = MAX(heap->stats.peak_live_bytes,
+	    heap->stats.live_bytes));
+	CHECK(bp);
+}
+
+/*
+ * Requires:
+ *   The heap is locked.  "bp" is the address of a free block that is at
+ *   least "asize" bytes, and "out" has room for "n" pointers.
+ *
+ * Effects:
+ *   Carve as many blocks of "asize" bytes as fit, up to "n", from the start
+ *   of the free block "bp" and store their addresses in "out".  Whatever is
+ *   left is split off as a single free block, or is added to the last block
+ *   if it is too small.  Returns the number of blocks carved.
+ */
+static size_t
+place_batch(void *bp, size_t asize, size_t n, void **out)
+{
+	size_t csize = GET_SIZE(HDRP(bp));
+	uintptr_t flags = GET_PREV_ALLOC(HDRP(bp));
+	uintptr_t zeroed = GET_ZEROED(HDRP(bp));
+	size_t i, k = MIN(n, csize / asize);
+
+	deleteBlock(bp);
+	STAT(heap->stats.splits[find_explicit(csize)] += k - (csize - k * asize <
+	    2 * DSIZE));
+	for (i = 0; i < k; i++) {
+		out[i] = bp;
+		csize -= asize;
+		if (i == k - 1 && csize < 2 * DSIZE)
+			asize += csize;
+		PUT(HDRP(bp), PACK(asize, ALLOC | flags));
+		flags = PREV_ALLOC;
+		bp = NEXT_BLKP(bp);
+	}
+	if (csize >= 2 * DSIZE) {
+		PUT(HDRP(bp), PACK(csize, PREV_ALLOC | zeroed));
+		PUT(FTRP(bp), PACK(csize, 0));
+		insertBlock(bp);
+		CHECK(bp);
 	} else {
-		PUT(HDRP(bp), PACK(csize, 1));
-		PUT(FTRP(bp), PACK(csize, 1));
-		struct Node* cur = (struct Node*) bp;
-		deleteBlock(cur);
+		SET_PREV_ALLOC(HDRP(bp));
+		CHECK(out[k - 1]);
 	}
+	STAT(heap->stats.peak_live_bytes = MAX(heap->stats.peak_live_bytes,
+	    heap->stats.live_bytes));
+	return (k);
+}
+
+/*
+ * Requires:
+ *   "a" and "b" point to block addresses.
+ *
+ * Effects:
+ *   Compare two block addresses for qsort().
+ */
+static int
+addr_cmp(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t)*(void *const *)a;
+	uintptr_t y = (uintptr_t)*(void *const *)b;
 
-	//checkheap(false);
+	return ((x > y) - (x < y));
 }
 
 /* 
@@ -490,9 +3305,19 @@ checkblock(void *bp)
 {
 
 	if ((uintptr_t)bp % DSIZE)
-		printf("Error: %p is not doubleword aligned\n", bp);
-	if (GET(HDRP(bp)) != GET(FTRP(bp)))
-		printf("Error: header does not match footer\n");
+		checkfail("block is not doubleword aligned", bp);
+	if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp)))
+		checkfail("header does not match footer", bp);
+	if (!GET_ALLOC(HDRP(bp)) != !GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp))))
+		checkfail("next block's previous-allocated bit is wrong", bp);
+	if (!GET_ALLOC(HDRP(bp)) && GET_ZEROED(HDRP(bp))) {
+		for (char *p = (char *)bp + FREE_META; p < FTRP(bp); p += WSIZE) {
+			if (GET(p) != 0) {
+				checkfail("block is marked zeroed but isn't", bp);
+				break;
+			}
+		}
+	}
 }
 
 /* 
@@ -508,14 +3333,14 @@ checkheap(bool verbose)
 	void *bp;
 
 	if (verbose)
-		printf("Heap (%p):\n", heap_listp);
+		printf("Heap (%p):\n", heap->heap_listp);
 
-	if (GET_SIZE(HDRP(heap_listp)) != DSIZE ||
-	    !GET_ALLOC(HDRP(heap_listp)))
-		printf("Bad prologue header\n");
-	checkblock(heap_listp);
+	if (GET_SIZE(HDRP(heap->heap_listp)) != DSIZE ||
+	    !GET_ALLOC(HDRP(heap->heap_listp)))
+		checkfail("bad prologue header", heap->heap_listp);
+	checkblock(heap->heap_listp);
 
-	for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+	for (bp = heap->heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
 		if (verbose)
 			printblock(bp);
 		checkblock(bp);
@@ -524,16 +3349,16 @@ checkheap(bool verbose)
 	if (verbose)
 		printblock(bp);
 	if (GET_SIZE(HDRP(bp)) != 0 || !GET_ALLOC(HDRP(bp))){
-		printf("Bad epilogue header\n");
+		checkfail("bad epilogue header", bp);
 	}
 
 	
 	for (unsigned int i = 0; i < NUM; i++){
-		struct Node* free_block = free_lists + i;
+		struct Node* free_block = heap->free_lists + i;
 		free_block = free_block->next;
 	
 		if (free_block != NULL){
-			while (free_block != free_lists + i) {
+			while (free_block != heap->free_lists + i) {
 				/* Check if every block in the free list 
 					* is a valid block.
 					*/
@@ -541,16 +3366,15 @@ checkheap(bool verbose)
 					
 				// check if every node in the free list is free
 				if (GET_ALLOC(HDRP(free_block))) {
-					printf("Block in free list is allocated\n");
-
+					checkfail("block in free list is allocated",
+					    free_block);
 				} else {
 					/* Check if there are any contiguous free block 
 					* that somehow escaped coalescing.
 					*/
-					if ((char *) GET(bp + WSIZE) != NULL && 
-					(void *) GET(bp + WSIZE) == 
-					NEXT_BLKP(free_block)) 
-						printf("Contiguous free blocks\n");
+					if (!GET_ALLOC(HDRP(NEXT_BLKP(free_block))))
+						checkfail("contiguous free blocks",
+						    free_block);
 				}
 				// iterate through the free list
 				free_block = free_block->next;
@@ -558,9 +3382,242 @@ checkheap(bool verbose)
 			}
 		}
 	}
+	checktree(heap->tree_root, NULL, NULL);
 		
 }
 
+/*
+ * Requires:
+ *   "t" is a subtree of TREE_BIN.  Every block in it must lie strictly
+ *   between "lo" and "hi" in (size, address) order, where NULL is no bound.
+ *
+ * Effects:
+ *   Perform a minimal check of every block in the subtree "t" and check
+ *   that the blocks are in order and belong in TREE_BIN.
+ */
+static void
+checktree(struct TreeNode *t, void *lo, void *hi)
+{
+	for (; t != NULL; t = t->right) {
+		checkblock(t);
+		if (GET_ALLOC(HDRP(t)))
+			checkfail("block in free tree is allocated", t);
+		if (find_explicit(GET_SIZE(HDRP(t))) != TREE_BIN)
+			checkfail("block in free tree has the wrong size", t);
+		if ((lo != NULL && !tree_before(lo, t)) ||
+		    (hi != NULL && !tree_before(t, hi)))
+			checkfail("free tree is out of order", t);
+		checktree(t->left, lo, t);
+		lo = t;
+	}
+}
+
+/*
+ * Requires:
+ *   "msg" describes what is wrong with the block "bp".
+ *
+ * Effects:
+ *   Report a failed check to the function set by mm_set_check(), or print
+ *   it if there is none.
+ */
+static void
+checkfail(const char *msg, void *bp)
+{
+	if (check_fail != NULL)
+		check_fail(msg, bp);
+	else
+		printf("Error: %p: %s\n", bp, msg);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Returns true if "p" is aligned and lies between the prologue and the
+ *   end of the heap, so that it is safe to read as a block.
+ */
+static bool
+checkptr(void *p)
+{
+	return ((uintptr_t)p % ALIGN == 0 && (char *)p > heap->heap_listp &&
+	    (char *)p <= (char *)mem_arena_hi(heap->index));
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of a block in the heap other than the epilogue.
+ *
+ * Effects:
+ *   Check the size of the block "bp" and the boundary tags it shares with
+ *   its neighbors, without touching the rest of the heap.  Returns false if
+ *   the block's size is so wrong that its neighbors can't be found.
+ */
+static bool
+checktags(void *bp)
+{
+	size_t size = GET_SIZE(HDRP(bp));
+	void *next;
+
+	if ((char *)bp + size > (char *)mem_arena_hi(heap->index) + 1 ||
+	    (size < 2 * DSIZE && (char *)bp != heap->heap_listp)) {
+		checkfail("block size is out of range", bp);
+		return (false);
+	}
+	next = NEXT_BLKP(bp);
+	if (!GET_ALLOC(HDRP(bp)) != !GET_PREV_ALLOC(HDRP(next)))
+		checkfail("next block's previous-allocated bit is wrong", bp);
+	if (GET_ALLOC(HDRP(bp)))
+		return (true);
+	if (size != GET_SIZE(FTRP(bp)))
+		checkfail("header does not match footer", bp);
+	if (!GET_PREV_ALLOC(HDRP(bp)) || !GET_ALLOC(HDRP(next)))
+		checkfail("contiguous free blocks", bp);
+	return (true);
+}
+
+/*
+ * Requires:
+ *   "bp" is a free block whose tags passed checktags().
+ *
+ * Effects:
+ *   Check that the free block "bp" is linked into the bin for its size:
+ *   its list neighbors link back to it and belong to the same bin, or its
+ *   children in the free tree are in order.
+ */
+static void
+checklinks(void *bp)
+{
+	int bin = find_explicit(GET_SIZE(HDRP(bp)));
+	struct Node *node = bp, *head = heap->free_lists + bin;
+	struct TreeNode *t = bp;
+
+	if ((heap->bin_map & (1UL << bin)) == 0)
+		checkfail("free block's bin is marked empty", bp);
+	if (bin == TREE_BIN) {
+		if ((t->left != NULL && (!checkptr(t->left) ||
+		    !tree_before(t->left, t) ||
+		    tree_priority(t->left) > tree_priority(t))) ||
+		    (t->right != NULL && (!checkptr(t->right) ||
+		    !tree_before(t, t->right) ||
+		    tree_priority(t->right) > tree_priority(t))))
+			checkfail("free tree is out of order", bp);
+		return;
+	}
+
+	/* The list heads lie in the heap, below the prologue. */
+	for (int i = 0; i < 2; i++) {
+		struct Node *n = i == 0 ? node->next : node->prev;
+
+		if (n == head)
+			continue;
+		if (!checkptr(n)) {
+			checkfail("free list link is not a block", bp);
+			return;
+		}
+		if (GET_ALLOC(HDRP(n)) ||
+		    find_explicit(GET_SIZE(HDRP(n))) != bin)
+			checkfail("free list neighbor is in another bin", bp);
+	}
+	if (node->next->prev != node || node->prev->next != node)
+		checkfail("free list links are not symmetric", bp);
+}
+
+/*
+ * Requires:
+ *   "run" is a run, and "bp" is about to be returned to it.
+ *
+ * Effects:
+ *   Check that "bp" is an object that "run" handed out, then check the
+ *   block that holds the run like any other block that an operation
+ *   touched.
+ */
+static void
+checkobject(struct run *run, void *bp)
+{
+	char *objs = (char *)run + RUN_HDRSIZE;
+
+	if (run->size == 0 || run->size > SLAB_MAX || run->size % ALIGN != 0 ||
+	    run->nused == 0 || run->nused > run->nobjs)
+		checkfail("run header is corrupt", run);
+	else if ((char *)bp < objs || (char *)bp >= run->bump ||
+	    ((char *)bp - objs) % run->size != 0)
+		checkfail("object is not in its run", bp);
+	checktouched(RUN_BLOCK(run));
+}
+
+/*
+ * Requires:
+ *   The sampling checker is on.  "bp" is a block that an operation just
+ *   allocated, freed or split, other than the epilogue.
+ *
+ * Effects:
+ *   Check the tags of "bp" and, if it is free, its links.  Every
+ *   check_interval calls, also check the next slice of the heap.
+ */
+static void
+checktouched(void *bp)
+{
+	if (checktags(bp) && !GET_ALLOC(HDRP(bp)))
+		checklinks(bp);
+	if (++heap->check_ops >= check_interval) {
+		heap->check_ops = 0;
+		checkslice();
+	}
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Check the next CHECK_SLICE blocks of a walk over the heap that starts
+ *   where the last slice ended, going back to the prologue at the end of
+ *   the heap.  The ZEROED bit is not verified, since that would read the
+ *   whole payload.
+ */
+static void
+checkslice(void)
+{
+	char *bp = heap->check_cursor;
+
+	if (bp == NULL || bp > (char *)mem_arena_hi(heap->index))
+		bp = heap->heap_listp;
+	for (int i = 0; i < CHECK_SLICE; i++) {
+		if (GET_SIZE(HDRP(bp)) == 0) {
+			if (bp != (char *)mem_arena_hi(heap->index) + 1 ||
+			    !GET_ALLOC(HDRP(bp)))
+				checkfail("bad epilogue header", bp);
+			bp = NULL;
+			break;
+		}
+		if (!checktags(bp)) {
+			bp = NULL;
+			break;
+		}
+		if (!GET_ALLOC(HDRP(bp)))
+			checklinks(bp);
+		bp = NEXT_BLKP(bp);
+	}
+	heap->check_cursor = bp;
+}
+
+/*
+ * Requires:
+ *   The block "bp" of "size" bytes was just formed from blocks that
+ *   included the ones after it.
+ *
+ * Effects:
+ *   Move the checker's walk to the start of "bp" if it was about to
+ *   resume at a block that no longer begins there.
+ */
+static void
+check_absorb(void *bp, size_t size)
+{
+	if (heap->check_cursor > (char *)bp && heap->check_cursor < (char *)bp + size)
+		heap->check_cursor = bp;
+}
+
 
 
 /*
@@ -579,13 +3636,17 @@ printblock(void *bp)
 	checkheap(false);
 	hsize = GET_SIZE(HDRP(bp));
 	halloc = GET_ALLOC(HDRP(bp));  
-	fsize = GET_SIZE(FTRP(bp));
-	falloc = GET_ALLOC(FTRP(bp));  
 
 	if (hsize == 0) {
 		printf("%p: end of heap\n", bp);
 		return;
 	}
+	if (halloc) {
+		printf("%p: header: [%zu:a]\n", bp, hsize);
+		return;
+	}
+	fsize = GET_SIZE(FTRP(bp));
+	falloc = GET_ALLOC(FTRP(bp));  
 
 	printf("%p: header: [%zu:%c] footer: [%zu:%c]\n", bp, 
 	    hsize, (halloc ? 'a' : 'f'), 
@@ -602,8 +3663,26 @@ printblock(void *bp)
 static void
 deleteBlock(void *bp){
 	struct Node *copy_bp = (struct Node *)bp;
+
+#if MM_STATS
+	int bin = find_explicit(GET_SIZE(HDRP(bp)));
+
+	heap->stats.free_bytes[bin] -= GET_SIZE(HDRP(bp));
+	heap->stats.free_blocks[bin]--;
+	heap->stats.live_bytes += GET_SIZE(HDRP(bp));
+#endif
+	if (find_explicit(GET_SIZE(HDRP(bp))) == TREE_BIN) {
+		heap->tree_root = tree_delete(heap->tree_root, bp);
+		if (heap->tree_root == NULL)
+			heap->bin_map &= ~(1UL << TREE_BIN);
+		return;
+	}
 	copy_bp->prev->next = copy_bp->next;
 	copy_bp->next->prev = copy_bp->prev;
+
+	/* Only the list head is left when its neighbors are the same node. */
+	if (copy_bp->prev == copy_bp->next)
+		heap->bin_map &= ~(1UL << (copy_bp->prev - heap->free_lists));
 }
 
 /*
@@ -622,8 +3701,18 @@ insertBlock(void *bp){
 
 	//Find the explicit list
 	int explicit = find_explicit(GET_SIZE(HDRP(bp)));
+#if MM_STATS
+	heap->stats.free_bytes[explicit] += GET_SIZE(HDRP(bp));
+	heap->stats.free_blocks[explicit]++;
+	heap->stats.live_bytes -= GET_SIZE(HDRP(bp));
+#endif
+	if (explicit == TREE_BIN) {
+		heap->tree_root = tree_insert(heap->tree_root, bp);
+		heap->bin_map |= 1UL << TREE_BIN;
+		return;
+	}
 	//The explicit free list ptr
-	head = free_lists + explicit;
+	head = heap->free_lists + explicit;
 	// The next free block in the explicit free list
 	temp = head->next;
 	
@@ -632,5 +3721,123 @@ insertBlock(void *bp){
 	temp->prev = cur;
 	cur->prev = head;
 	cur->next = temp;
-	
-}
\ No newline at end of file
+	heap->bin_map |= 1UL << explicit;
+}
+
+/*
+ * Requires:
+ *   "a" and "b" are free blocks in TREE_BIN.
+ *
+ * Effects:
+ *   Returns true if "a" comes before "b", that is, if it is smaller or it
+ *   is the same size and at a lower address.
+ */
+static bool
+tree_before(void *a, void *b)
+{
+	size_t asize = GET_SIZE(HDRP(a)), bsize = GET_SIZE(HDRP(b));
+
+	return (asize < bsize || (asize == bsize && a < b));
+}
+
+/*
+ * Requires:
+ *   "bp" is a free block.
+ *
+ * Effects:
+ *   Returns the treap priority of "bp", a hash of its address.
+ */
+static uintptr_t
+tree_priority(void *bp)
+{
+	return ((uintptr_t)bp * (uintptr_t)0x9E3779B97F4A7C15ULL);
+}
+
+/*
+ * Requires:
+ *   Every block in "a" comes before every block in "b".
+ *
+ * Effects:
+ *   Joins the treaps "a" and "b" and returns the root of the result.
+ */
+static struct TreeNode *
+tree_merge(struct TreeNode *a, struct TreeNode *b)
+{
+	if (a == NULL)
+		return (b);
+	if (b == NULL)
+		return (a);
+	if (tree_priority(a) > tree_priority(b)) {
+		a->right = tree_merge(a->right, b);
+		return (a);
+	}
+	b->left = tree_merge(a, b->left);
+	return (b);
+}
+
+/*
+ * Requires:
+ *   "node" is a free block that is not in the treap "t".
+ *
+ * Effects:
+ *   Splits "t" into the blocks that come before "node", stored in "*l", and
+ *   those that come after it, stored in "*r".
+ */
+static void
+tree_split(struct TreeNode *t, struct TreeNode *node, struct TreeNode **l,
+    struct TreeNode **r)
+{
+	while (t != NULL) {
+		if (tree_before(t, node)) {
+			*l = t;
+			l = &t->right;
+			t = t->right;
+		} else {
+			*r = t;
+			r = &t->left;
+			t = t->left;
+		}
+	}
+	*l = NULL;
+	*r = NULL;
+}
+
+/*
+ * Requires:
+ *   "node" is a free block in TREE_BIN that is not in the treap "t".
+ *
+ * Effects:
+ *   Inserts "node" into "t" and returns the new root.
+ */
+static struct TreeNode *
+tree_insert(struct TreeNode *t, struct TreeNode *node)
+{
+	struct TreeNode **link = &t;
+	uintptr_t prio = tree_priority(node);
+
+	while (*link != NULL && tree_priority(*link) > prio)
+		link = tree_before(node, *link) ? &(*link)->left :
+		    &(*link)->right;
+	tree_split(*link, node, &node->left, &node->right);
+	*link = node;
+	return (t);
+}
+
+/*
+ * Requires:
+ *   "node" is a block in the treap "t".
+ *
+ * Effects:
+ *   Removes "node" from "t" and returns the new root.
+ */
+static struct TreeNode *
+tree_delete(struct TreeNode *t, struct TreeNode *node)
+{
+	struct TreeNode **link = &t;
+
+	while (*link != node)
+		link = tree_before(node, *link) ? &(*link)->left :
+		    &(*link)->right;
+	*link = tree_merge(node->left, node->right);
+	return (t);
+}
@@ -2,10 +2,89 @@
  * The public interface to the students' memory allocator.
  */
 
+/*
+ * A build of mm.c with MM_PREFIX defined names its functions with that
+ * prefix instead of "mm", so that the driver can link several builds of it
+ * with different settings.
+ */
+#ifdef MM_PREFIX
+#define MM_NAME(name)		MM_NAME_(MM_PREFIX, name)
+#define MM_NAME_(prefix, name)	MM_NAME__(prefix, name)
+#define MM_NAME__(prefix, name)	prefix##_##name
+#define mm_init			MM_NAME(init)
+#define mm_malloc		MM_NAME(malloc)
+#define mm_free			MM_NAME(free)
+#define mm_free_sized		MM_NAME(free_sized)
+#define mm_usable_size		MM_NAME(usable_size)
+#define mm_realloc		MM_NAME(realloc)
+#define mm_memalign		MM_NAME(memalign)
+#define mm_aligned_alloc	MM_NAME(aligned_alloc)
+#define mm_calloc		MM_NAME(calloc)
+#define mm_malloc_batch		MM_NAME(malloc_batch)
+#define mm_free_batch		MM_NAME(free_batch)
+#define mm_get_stats		MM_NAME(get_stats)
+#define mm_set_check		MM_NAME(set_check)
+#define mm_set_profile		MM_NAME(set_profile)
+#define mm_dump_profile		MM_NAME(dump_profile)
+#define team			MM_NAME(team)
+#endif
+
 int	 mm_init(void);
 void	*mm_malloc(size_t size);
 void	 mm_free(void *ptr);
+void	 mm_free_sized(void *ptr, size_t size);
+size_t	 mm_usable_size(void *ptr);
 void	*mm_realloc(void *ptr, size_t size);
+void	*mm_memalign(size_t alignment, size_t size);
+void	*mm_aligned_alloc(size_t alignment, size_t size);
+void	*mm_calloc(size_t nmemb, size_t size);
+size_t	 mm_malloc_batch(size_t size, size_t n, void **out);
+void	 mm_free_batch(void **ptrs, size_t n);
+
+/*
+ * Allocator statistics, filled in by mm_get_stats() when the allocator is
+ * built with MM_STATS.  Arrays of MM_STATS_BINS counters are indexed by
+ * free list bin.  probes[0] counts the searches of the free lists that
+ * examined no block, and probes[i] those that examined between 2^(i - 1)
+ * and 2^i - 1 blocks, with the last bucket also counting longer ones.
+ */
+#define MM_STATS_BINS		32
+#define MM_STATS_PROBE_BUCKETS	8
+
+struct mm_stats {
+	unsigned long	mallocs[MM_STATS_BINS];	/* Requests, by block bin. */
+	unsigned long	frees[MM_STATS_BINS];	/* Frees, by block bin. */
+	unsigned long	splits[MM_STATS_BINS];	/* Splits, by split block's bin. */
+	unsigned long	coalesces[4];		/* Coalesces, by case. */
+	unsigned long	probes[MM_STATS_PROBE_BUCKETS];
+	unsigned long	extends;		/* Calls that grew the heap. */
+	size_t		extend_bytes;		/* Bytes the heap grew by. */
+	size_t		live_bytes;		/* Heap bytes not in free blocks. */
+	size_t		peak_live_bytes;	/* Most live_bytes since mm_init(). */
+	size_t		free_bytes[MM_STATS_BINS];
+	unsigned long	free_blocks[MM_STATS_BINS];
+};
+
+int	 mm_get_stats(struct mm_stats *stats);
+
+/*
+ * Sampling heap checker.  A nonzero interval makes every heap operation
+ * check the blocks it touched and every "interval" operations also check
+ * the next slice of the heap.  Failures are passed to "fail", or printed
+ * if it is NULL.
+ */
+typedef void (*mm_check_fail_t)(const char *msg, void *bp);
+
+void	 mm_set_check(unsigned int interval, mm_check_fail_t fail);
+
+/*
+ * Sampling heap profiler, built with MM_PROFILE.  A nonzero rate samples
+ * about one allocation per "rate" bytes along with its call stack, and
+ * mm_dump_profile() writes the sampled live blocks to "fd" as a pprof
+ * heap profile.
+ */
+int	 mm_set_profile(size_t rate);
+int	 mm_dump_profile(int fd);
 
 /*
  * Students work in teams of one or two.  Teams enter their team name, personal
@@ -0,0 +1,363 @@
+/*
+ * shim.c - Replaces the C library's malloc with the mm.c allocator, so
+ *          that real programs can be run on it with LD_PRELOAD=./libmm.so.
+ *
+ *          If MM_RECORD names a file, every request is also recorded
+ *          there, and "mdriver -f <file>" replays the program's requests.
+ *          Each thread appends records to a buffer of its own and writes
+ *          the buffer out with a single write() when it fills up, so the
+ *          only shared state that recording touches is one atomic counter
+ *          that orders the requests.  Records hold addresses rather than
+ *          ids; the driver assigns ids when it reads the log.
+ *
+ *          With MM_PROFILE_RATE set, the heap profiler samples about one
+ *          allocation per that many bytes.  malloc_dump_profile() writes
+ *          a pprof heap profile on demand, and one is written at exit to
+ *          the file that MM_PROFILE_OUT names.
+ *
+ *          Programs with more than one thread need mm.c to be built with
+ *          MM_THREADS.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "trace.h"
+
+/* Records that a thread buffers before it writes them out */
+#define LOG_RECS 4096
+
+#define EXPORT __attribute__((visibility("default")))
+
+/* The records that one thread has not written out yet */
+typedef struct logbuf_t {
+    struct logbuf_t *next;  /* every buffer, for the flush at exit */
+    int busy;               /* owned by a live thread */
+    unsigned count;         /* records in recs */
+    logrec_t recs[LOG_RECS];
+} logbuf_t;
+
+static pthread_once_t shim_once = PTHREAD_ONCE_INIT;
+static pthread_key_t log_key;     /* Releases a thread's buffer at exit */
+static int log_fd = -1;           /* The log, or -1 if not recording */
+static uint64_t log_seq;          /* Requests recorded so far */
+static logbuf_t *log_bufs;        /* Lock-free list of every buffer */
+static __thread logbuf_t *log_buf; /* The calling thread's buffer */
+
+static void shim_init(void);
+static void log_flush(logbuf_t *buf);
+static void log_release(void *arg);
+static logbuf_t *log_get(void);
+static void log_op(uint64_t seq, int type, void *addr, void *old,
+		   size_t size);
+
+/*
+ * INIT - Initialize the heap, and open the log, before the first request
+ */
+#define INIT() pthread_once(&shim_once, shim_init)
+
+/*
+ * SEQ - Claim the next position in the log, or 0 if not recording.  A
+ *     free claims it before the block can be reused, and an allocation
+ *     after it has its block.
+ */
+#define SEQ() ((log_fd >= 0) ? \
+	       __atomic_fetch_add(&log_seq, 1, __ATOMIC_RELAXED) : 0)
+
+/*********************************
+ * The replacements for libc's API
+ *********************************/
+
+EXPORT void *malloc(size_t size)
+{
+    void *p;
+
+    INIT();
+    if ((p = mm_malloc(size ? size : 1)) == NULL)
+	errno = ENOMEM;
+    log_op(SEQ(), ALLOC, p, NULL, size);
+    return p;
+}
+
+EXPORT void free(void *p)
+{
+    /* Blocks that are not ours, such as the loader's, are left alone */
+    if (p == NULL || !mem_is_heap(p, p))
+	return;
+    log_op(SEQ(), FREE, p, NULL, 0);
+    mm_free(p);
+}
+
+EXPORT void *realloc(void *old, size_t size)
+{
+    void *p;
+
+    INIT();
+    if (old != NULL && !mem_is_heap(old, old)) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if (old != NULL && size == 0) {
+	free(old);
+	return NULL;
+    }
+    if ((p = mm_realloc(old, size ? size : 1)) == NULL)
+	errno = ENOMEM;
+    else
+	log_op(SEQ(), REALLOC, p, old, size);
+    return p;
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    INIT();
+    if (nmemb == 0 || size == 0)
+	nmemb = size = 1;
+    if ((p = mm_calloc(nmemb, size)) == NULL)
+	errno = ENOMEM;
+    else
+	log_op(SEQ(), ALLOC, p, NULL, nmemb * size);
+    return p;
+}
+
+EXPORT void *memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    INIT();
+    if ((p = mm_memalign(alignment, size ? size : 1)) == NULL)
+	errno = (alignment & (alignment - 1)) ? EINVAL : ENOMEM;
+    log_op(SEQ(), ALLOC, p, NULL, size);
+    return p;
+}
+
+EXPORT void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+EXPORT int posix_memalign(void **out, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)))
+	return EINVAL;
+    if ((p = memalign(alignment, size)) == NULL)
+	return ENOMEM;
+    *out = p;
+    return 0;
+}
+
+EXPORT void *valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+EXPORT void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+EXPORT size_t malloc_usable_size(void *p)
+{
+    if (p == NULL || !mem_is_heap(p, p))
+	return 0;
+    return mm_usable_size(p);
+}
+
+/*
+ * malloc_set_profile - Let the program change the profiler's sampling
+ *     rate, 0 turning it off
+ */
+EXPORT int malloc_set_profile(size_t rate)
+{
+    INIT();
+    return mm_set_profile(rate);
+}
+
+/*
+ * malloc_dump_profile - Let the program write a heap profile to fd
+ */
+EXPORT int malloc_dump_profile(int fd)
+{
+    INIT();
+    return mm_dump_profile(fd);
+}
+
+/***********************************
+ * Initialization and the request log
+ ***********************************/
+
+/*
+ * shim_init - Set up the heap, and the log if MM_RECORD names one
+ */
+static void shim_init(void)
+{
+    loghdr_t hdr;
+    char *path, *rate;
+    int fd;
+
+    mem_init();
+    if (mm_init() < 0)
+	abort();
+    if ((rate = getenv("MM_PROFILE_RATE")) != NULL)
+	mm_set_profile(strtoul(rate, NULL, 0));
+    if ((path = getenv("MM_RECORD")) == NULL || *path == '\0')
+	return;
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+		   0644)) < 0)
+	return;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, LOG_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = BIN_BYTE_ORDER;
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+	close(fd);
+	return;
+    }
+    pthread_key_create(&log_key, log_release);
+    log_fd = fd;
+}
+
+/*
+ * shim_fork - Stop recording in a child, whose requests would interleave
+ *     with the parent's in the log
+ */
+static void shim_fork(void)
+{
+    log_fd = -1;
+    log_buf = NULL;
+}
+
+/*
+ * shim_ctor - Register shim_fork() once the C library is up
+ */
+__attribute__((constructor)) static void shim_ctor(void)
+{
+    pthread_atfork(NULL, NULL, shim_fork);
+}
+
+/*
+ * shim_dtor - Write the heap profile, and every buffer of the log, at
+ *     exit.  Records that threads still running add afterwards are lost.
+ */
+__attribute__((destructor)) static void shim_dtor(void)
+{
+    logbuf_t *buf;
+    char *path;
+    int fd;
+
+    if ((path = getenv("MM_PROFILE_OUT")) != NULL && *path != '\0' &&
+	(fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		   0644)) >= 0) {
+	mm_dump_profile(fd);
+	close(fd);
+    }
+    if ((fd = log_fd) < 0)
+	return;
+    for (buf = __atomic_load_n(&log_bufs, __ATOMIC_ACQUIRE); buf != NULL;
+	 buf = buf->next)
+	log_flush(buf);
+    log_fd = -1;
+    close(fd);
+}
+
+/*
+ * log_op - Append a request to the calling thread's buffer, writing the
+ *     buffer out first if it is full.  Failed requests aren't recorded.
+ */
+static void log_op(uint64_t seq, int type, void *addr, void *old,
+		   size_t size)
+{
+    logbuf_t *buf;
+    logrec_t *rec;
+
+    if (log_fd < 0 || addr == NULL || (buf = log_get()) == NULL)
+	return;
+    if (buf->count == LOG_RECS)
+	log_flush(buf);
+    rec = &buf->recs[buf->count];
+    rec->seq = seq;
+    rec->addr = (uintptr_t)addr;
+    rec->old = (uintptr_t)old;
+    rec->size = (size > UINT32_MAX) ? UINT32_MAX : size;
+    rec->type = type;
+    buf->count++;
+}
+
+/*
+ * log_flush - Write out a buffer's records with one write(), which the
+ *     log's O_APPEND keeps from interleaving with other threads' writes
+ */
+static void log_flush(logbuf_t *buf)
+{
+    char *p = (char *)buf->recs;
+    size_t left = buf->count * sizeof(logrec_t);
+    ssize_t n;
+
+    while (left > 0 && (n = write(log_fd, p, left)) > 0) {
+	p += n;
+	left -= n;
+    }
+    buf->count = 0;
+}
+
+/*
+ * log_get - Return the calling thread's buffer, taking over the buffer of
+ *     a thread that has exited or mapping a new one
+ */
+static logbuf_t *log_get(void)
+{
+    logbuf_t *buf;
+    int idle = 0;
+
+    if (log_buf != NULL)
+	return log_buf;
+    for (buf = __atomic_load_n(&log_bufs, __ATOMIC_ACQUIRE); buf != NULL;
+	 buf = buf->next) {
+	idle = 0;
+	if (__atomic_compare_exchange_n(&buf->busy, &idle, 1, 0,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	    break;
+    }
+    if (buf == NULL) {
+	if ((buf = mmap(NULL, sizeof(logbuf_t), PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+	    return NULL;
+	buf->busy = 1;
+	buf->next = __atomic_load_n(&log_bufs, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&log_bufs, &buf->next, buf, 1,
+					    __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED))
+	    ;
+    }
+
+    /* Set log_buf first in case pthread_setspecific() calls malloc */
+    log_buf = buf;
+    pthread_setspecific(log_key, buf);
+    return buf;
+}
+
+/*
+ * log_release - Write out an exiting thread's buffer and let another
+ *     thread take it over
+ */
+static void log_release(void *arg)
+{
+    logbuf_t *buf = arg;
+
+    if (log_fd >= 0)
+	log_flush(buf);
+    log_buf = NULL;
+    __atomic_store_n(&buf->busy, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,67 @@
+/*
+ * trace.h - The layout of binary trace files and of recorded request logs,
+ *           shared by mdriver, tracegen and the malloc shim
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdint.h>
+
+/* Binary trace files start with this magic number */
+#define BIN_MAGIC      "MMTRACE1"
+#define BIN_BYTE_ORDER 0x01020304 /* as written by the host that made it */
+
+/*
+ * Characterizes a single trace operation (allocator request).  This is
+ * also how ops are stored in a binary trace file, so the ops of a mapped
+ * binary trace are used where they are.
+ */
+enum {ALLOC, FREE, REALLOC};
+typedef struct {
+    uint32_t type : 2;      /* type of request */
+    uint32_t index : 30;    /* index for free() to use later */
+    uint32_t size;          /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* The header of a binary trace file, which is followed by its ops */
+typedef struct {
+    char magic[8];            /* BIN_MAGIC */
+    uint32_t byte_order;      /* BIN_BYTE_ORDER */
+    uint32_t sugg_heapsize;   /* suggested heap size (unused) */
+    uint32_t num_ids;         /* number of alloc/realloc ids */
+    uint32_t num_ops;         /* number of distinct requests */
+    uint32_t weight;          /* weight for this trace (unused) */
+    uint32_t reserved;        /* zero; keeps the ops 8-byte aligned */
+} binhdr_t;
+
+_Static_assert(sizeof(traceop_t) == 8, "binary trace ops are 8 bytes");
+_Static_assert(sizeof(binhdr_t) % 8 == 0, "binary trace ops are aligned");
+
+/*
+ * The shim records a program's requests in a log that starts with this
+ * magic number.  The driver turns a log into a trace when it reads it.
+ */
+#define LOG_MAGIC      "MMLOG001"
+
+/* The header of a request log, which is followed by its records */
+typedef struct {
+    char magic[8];            /* LOG_MAGIC */
+    uint32_t byte_order;      /* BIN_BYTE_ORDER */
+    uint32_t reserved;        /* zero */
+} loghdr_t;
+
+/*
+ * One recorded request.  Threads write their records in batches, so the
+ * records of a log are in the order of seq only within a batch.
+ */
+typedef struct {
+    uint64_t seq;             /* position of the request in the program */
+    uint64_t addr;            /* block returned, or freed */
+    uint64_t old;             /* block that was reallocated */
+    uint32_t size;            /* byte size of alloc/realloc request */
+    uint32_t type;            /* ALLOC, FREE or REALLOC */
+} logrec_t;
+
+_Static_assert(sizeof(logrec_t) == 32, "log records are 32 bytes");
+
+#endif /* __TRACE_H_ */
@@ -0,0 +1,563 @@
+/*
+ * tracegen.c - Synthetic trace generator for the malloc lab driver
+ *
+ * Writes a trace that mdriver can replay, in its text format or in its
+ * binary format, from a parameterized model of a workload.  Request sizes
+ * follow a power law or a bimodal distribution.  Blocks are freed in FIFO,
+ * LIFO or random order, either while the heap hovers around a steady
+ * state or in producer-consumer phases that fill it and then drain it.
+ * Some blocks can also grow through chains of reallocs.
+ *
+ * The same seed always gives the same trace.  The trace is generated
+ * twice, once to count its ids and ops for the header and once to write
+ * it, so even traces of 10^8 ops take only as much memory as their live
+ * blocks.  Freed ids are reused, so a trace has as many ids as it ever
+ * has live blocks.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+
+#include "trace.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define DEF_OPS      100000     /* ops in a trace */
+#define DEF_LIVE     (4 << 20)  /* most live bytes; the heap is 20 MB */
+#define DEF_SEED     1
+#define MIN_OPS      2
+#define INIT_SLOTS   1024       /* initial capacity of the id arrays */
+
+/* Size distributions */
+#define DIST_POWER   0
+#define DIST_BIMODAL 1
+
+/* Orders in which live blocks are freed */
+#define LIFE_FIFO    0
+#define LIFE_LIFO    1
+#define LIFE_RANDOM  2
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* The parameters of a workload */
+typedef struct {
+    int dist;             /* DIST_POWER or DIST_BIMODAL */
+    double alpha;         /* power law exponent */
+    unsigned min_size;    /* smallest power law size */
+    unsigned max_size;    /* largest power law size */
+    unsigned small;       /* typical small bimodal size */
+    unsigned large;       /* typical large bimodal size */
+    double p_small;       /* fraction of bimodal sizes that are small */
+    int lifetime;         /* LIFE_FIFO, LIFE_LIFO or LIFE_RANDOM */
+    int phases;           /* alternate filling and draining the heap */
+    double p_chain;       /* fraction of allocs that start a realloc chain */
+    uint64_t num_ops;     /* ops to generate */
+    size_t max_live;      /* most bytes live at once */
+    uint64_t seed;        /* seed of the random number generator */
+} model_t;
+
+/* The state of one pass over the trace */
+typedef struct {
+    model_t *m;
+    uint64_t rng;         /* xorshift64* state */
+    FILE *out;            /* where ops go, or NULL when only counting */
+    int binary;           /* write the binary format */
+    uint64_t ops;         /* ops generated so far */
+    uint32_t *live;       /* ring of live ids, oldest first... */
+    uint32_t head;        /* ... starting here... */
+    uint32_t count;       /* ... holding this many... */
+    uint32_t cap;         /* ... out of a power of two */
+    uint32_t *free_ids;   /* stack of ids that can be reused */
+    uint32_t num_free;
+    uint32_t *sizes;      /* size of the block of each id */
+    uint32_t num_ids;     /* ids handed out so far */
+    uint32_t id_cap;      /* capacity of free_ids and sizes */
+    size_t live_bytes;    /* bytes live now... */
+    size_t peak_bytes;    /* ... and at most */
+    int producing;        /* in a phase that fills the heap */
+    int chaining;         /* a realloc chain is in progress... */
+    uint32_t chain_id;    /* ... on this id... */
+    uint32_t chain_target;/* ... and ends at this size */
+} gen_t;
+
+/***********************************
+ * Function prototypes
+ ***********************************/
+
+static void generate(model_t *m, FILE *out, int binary, gen_t *g);
+static void gen_alloc(gen_t *g);
+static void gen_free(gen_t *g);
+static void gen_chain(gen_t *g);
+static void end_chain(gen_t *g);
+static int want_alloc(gen_t *g);
+static void push_live(gen_t *g, uint32_t id);
+static uint32_t new_id(gen_t *g);
+static uint32_t draw_size(gen_t *g);
+static void emit(gen_t *g, int type, uint32_t id, uint32_t size);
+static void write_header(gen_t *g, FILE *out, int binary);
+static uint64_t rnd(gen_t *g);
+static double rnd01(gen_t *g);
+static void parse_dist(model_t *m, char *arg);
+static void usage(void);
+static void unix_error(char *msg);
+static void app_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    model_t m;
+    gen_t g;
+    FILE *out = stdout;
+    char *outfile = NULL;  /* If set, write the trace there (-o) */
+    int binary = 0;        /* If set, write the binary format (-b) */
+    int c;
+
+    m.dist = DIST_POWER;
+    m.alpha = 1.5;
+    m.min_size = 16;
+    m.max_size = 16384;
+    m.small = 32;
+    m.large = 4096;
+    m.p_small = 0.9;
+    m.lifetime = LIFE_RANDOM;
+    m.phases = 0;
+    m.p_chain = 0;
+    m.num_ops = DEF_OPS;
+    m.max_live = DEF_LIVE;
+    m.seed = DEF_SEED;
+
+    while ((c = getopt(argc, argv, "bd:hl:m:n:o:Pr:s:")) != EOF) {
+	switch (c) {
+	case 'b': /* Write the binary format */
+	    binary = 1;
+	    break;
+	case 'd': /* Size distribution */
+	    parse_dist(&m, optarg);
+	    break;
+	case 'l': /* Order in which blocks are freed */
+	    if (!strcmp(optarg, "fifo"))
+		m.lifetime = LIFE_FIFO;
+	    else if (!strcmp(optarg, "lifo"))
+		m.lifetime = LIFE_LIFO;
+	    else if (!strcmp(optarg, "random"))
+		m.lifetime = LIFE_RANDOM;
+	    else {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'm': /* Most live bytes */
+	    m.max_live = strtoull(optarg, NULL, 0);
+	    break;
+	case 'n': /* Number of ops */
+	    m.num_ops = strtoull(optarg, NULL, 0);
+	    break;
+	case 'o': /* Output file */
+	    outfile = optarg;
+	    break;
+	case 'P': /* Producer-consumer phases */
+	    m.phases = 1;
+	    break;
+	case 'r': /* Percentage of allocs that start a realloc chain */
+	    m.p_chain = atof(optarg) / 100;
+	    break;
+	case 's': /* Seed */
+	    m.seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'h': /* Print this message */
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind != argc) {
+	usage();
+	exit(1);
+    }
+    if (m.num_ops < MIN_OPS || m.num_ops > UINT32_MAX)
+	app_error("The number of ops must be at least 2 and fit in 32 bits");
+    if (m.p_chain < 0 || m.p_chain > 1)
+	app_error("The realloc chain percentage must be between 0 and 100");
+    if ((m.dist == DIST_POWER ? m.max_size : m.large + m.large / 2) >
+	m.max_live)
+	app_error("The largest request must fit in the live bytes");
+
+    /* Count the ids and ops, then write the header and the ops */
+    generate(&m, NULL, binary, &g);
+    if (outfile != NULL && (out = fopen(outfile, "w")) == NULL) {
+	fprintf(stderr, "Could not open %s\n", outfile);
+	unix_error("fopen failed in main");
+    }
+    write_header(&g, out, binary);
+    generate(&m, out, binary, &g);
+    if (fflush(out) != 0 || (outfile != NULL && fclose(out) != 0))
+	unix_error("Could not write the trace");
+    exit(0);
+}
+
+/*****************************************************************
+ * The generator itself
+ ****************************************************************/
+
+/*
+ * generate - Make one pass over the trace that model m describes, writing
+ *     each op to out unless it is NULL.  g is left holding the totals.
+ */
+static void generate(model_t *m, FILE *out, int binary, gen_t *g)
+{
+    static gen_t zero;
+    uint64_t x;
+
+    *g = zero;
+    g->m = m;
+    g->out = out;
+    g->binary = binary;
+    g->cap = INIT_SLOTS;
+    g->id_cap = INIT_SLOTS;
+    g->producing = 1;
+    if ((g->live = malloc(g->cap * sizeof(uint32_t))) == NULL ||
+	(g->free_ids = malloc(g->id_cap * sizeof(uint32_t))) == NULL ||
+	(g->sizes = malloc(g->id_cap * sizeof(uint32_t))) == NULL)
+	unix_error("malloc failed in generate");
+
+    /* Seed xorshift64* through splitmix64, which never yields zero here */
+    x = m->seed + 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    g->rng = (x ^ (x >> 31)) | 1;
+
+    /* Leave enough ops to free every block that is still live */
+    while (g->ops + g->count + g->chaining < m->num_ops) {
+	if (g->chaining && (rnd(g) & 1))
+	    gen_chain(g);
+	else if ((want_alloc(g) || g->count == 0) &&
+		 g->ops + g->count + g->chaining + 2 <= m->num_ops)
+	    gen_alloc(g);
+	else if (g->count > 0)
+	    gen_free(g);
+	else
+	    break;
+    }
+    if (g->chaining)
+	end_chain(g);
+    while (g->count > 0)
+	gen_free(g);
+
+    free(g->live);
+    free(g->free_ids);
+    free(g->sizes);
+}
+
+/*
+ * gen_alloc - Allocate a block, unless it wouldn't fit in the live bytes,
+ *     in which case a block is freed instead.  The new block may start a
+ *     realloc chain.
+ */
+static void gen_alloc(gen_t *g)
+{
+    uint32_t size = draw_size(g), id;
+    size_t target;
+
+    if (g->live_bytes + size > g->m->max_live && g->count > 0) {
+	gen_free(g);
+	return;
+    }
+    id = new_id(g);
+    g->sizes[id] = size;
+    g->live_bytes += size;
+    if (g->live_bytes > g->peak_bytes)
+	g->peak_bytes = g->live_bytes;
+    emit(g, ALLOC, id, size);
+
+    if (!g->chaining && rnd01(g) < g->m->p_chain) {
+	target = (size_t)size << (1 + rnd(g) % 8);
+	if (target > g->m->max_live / 4)
+	    target = g->m->max_live / 4;
+	if (target > UINT32_MAX)
+	    target = UINT32_MAX;
+	g->chaining = 1;
+	g->chain_id = id;
+	g->chain_target = target;
+    } else
+	push_live(g, id);
+}
+
+/*
+ * gen_free - Free the live block that the lifetime model picks
+ */
+static void gen_free(gen_t *g)
+{
+    uint32_t mask = g->cap - 1, pos, last, id;
+
+    last = (g->head + g->count - 1) & mask;
+    switch (g->m->lifetime) {
+    case LIFE_FIFO:
+	id = g->live[g->head];
+	g->head = (g->head + 1) & mask;
+	break;
+    case LIFE_LIFO:
+	id = g->live[last];
+	break;
+    default:
+	pos = (g->head + rnd(g) % g->count) & mask;
+	id = g->live[pos];
+	g->live[pos] = g->live[last];
+	break;
+    }
+    g->count--;
+    g->live_bytes -= g->sizes[id];
+    g->free_ids[g->num_free++] = id;
+    emit(g, FREE, id, 0);
+}
+
+/*
+ * gen_chain - Grow the block of the realloc chain by a quarter to all of
+ *     its size, or end the chain once it reaches its target
+ */
+static void gen_chain(gen_t *g)
+{
+    uint32_t id = g->chain_id, size = g->sizes[id];
+    size_t next = size + (size_t)(size * (0.25 + 0.75 * rnd01(g))) + 1;
+
+    if (next > g->chain_target ||
+	g->live_bytes + (next - size) > g->m->max_live) {
+	end_chain(g);
+	return;
+    }
+    g->sizes[id] = next;
+    g->live_bytes += next - size;
+    if (g->live_bytes > g->peak_bytes)
+	g->peak_bytes = g->live_bytes;
+    emit(g, REALLOC, id, next);
+}
+
+/*
+ * end_chain - Make the block of the realloc chain an ordinary live block
+ */
+static void end_chain(gen_t *g)
+{
+    g->chaining = 0;
+    push_live(g, g->chain_id);
+}
+
+/*
+ * want_alloc - Decide whether the next op allocates.  In the steady state
+ *     that is as likely as the heap is empty, so the live bytes hover
+ *     around half of the most.  With phases, the heap fills up to the most
+ *     and then drains to an eighth of it.
+ */
+static int want_alloc(gen_t *g)
+{
+    if (!g->m->phases)
+	return rnd01(g) * g->m->max_live >= g->live_bytes;
+    if (g->producing && g->live_bytes + g->m->max_live / 64 >
+	g->m->max_live)
+	g->producing = 0;
+    else if (!g->producing && g->live_bytes <= g->m->max_live / 8)
+	g->producing = 1;
+    return g->producing;
+}
+
+/*
+ * push_live - Add an id to the newest end of the ring of live ids
+ */
+static void push_live(gen_t *g, uint32_t id)
+{
+    uint32_t *live, i;
+
+    if (g->count == g->cap) {
+	if ((live = malloc(2 * g->cap * sizeof(uint32_t))) == NULL)
+	    unix_error("malloc failed in push_live");
+	for (i = 0; i < g->count; i++)
+	    live[i] = g->live[(g->head + i) & (g->cap - 1)];
+	free(g->live);
+	g->live = live;
+	g->head = 0;
+	g->cap *= 2;
+    }
+    g->live[(g->head + g->count++) & (g->cap - 1)] = id;
+}
+
+/*
+ * new_id - Reuse the most recently freed id, or hand out a new one
+ */
+static uint32_t new_id(gen_t *g)
+{
+    if (g->num_free > 0)
+	return g->free_ids[--g->num_free];
+    if (g->num_ids == g->id_cap) {
+	g->id_cap *= 2;
+	if ((g->free_ids = realloc(g->free_ids,
+				   g->id_cap * sizeof(uint32_t))) == NULL ||
+	    (g->sizes = realloc(g->sizes,
+				g->id_cap * sizeof(uint32_t))) == NULL)
+	    unix_error("realloc failed in new_id");
+    }
+    return g->num_ids++;
+}
+
+/*
+ * draw_size - Draw a request size from the size distribution.  Power law
+ *     sizes are drawn from a Pareto distribution truncated to
+ *     [min_size, max_size] by inverting its CDF.  Bimodal sizes are drawn
+ *     uniformly from half to one and a half times either mode.
+ */
+static uint32_t draw_size(gen_t *g)
+{
+    model_t *m = g->m;
+    double tail;
+    unsigned mode;
+
+    if (m->dist == DIST_POWER) {
+	tail = 1 - pow((double)m->min_size / m->max_size, m->alpha);
+	return m->min_size / pow(1 - rnd01(g) * tail, 1 / m->alpha);
+    }
+    mode = (rnd01(g) < m->p_small) ? m->small : m->large;
+    return mode / 2 + rnd(g) % (mode + 1);
+}
+
+/*
+ * emit - Count an op and write it out, unless this pass only counts
+ */
+static void emit(gen_t *g, int type, uint32_t id, uint32_t size)
+{
+    traceop_t op;
+
+    g->ops++;
+    if (g->out == NULL)
+	return;
+    if (g->binary) {
+	op.type = type;
+	op.index = id;
+	op.size = size;
+	if (fwrite(&op, sizeof(op), 1, g->out) != 1)
+	    unix_error("Could not write the trace");
+    } else if (type == FREE)
+	fprintf(g->out, "f %u\n", id);
+    else
+	fprintf(g->out, "%c %u %u\n", (type == ALLOC) ? 'a' : 'r', id, size);
+}
+
+/*
+ * write_header - Write the header of the trace that g counted
+ */
+static void write_header(gen_t *g, FILE *out, int binary)
+{
+    binhdr_t hdr;
+    uint32_t heapsize = (g->peak_bytes > UINT32_MAX) ? UINT32_MAX :
+	g->peak_bytes;
+
+    if (!binary) {
+	fprintf(out, "%u\n%u\n%u\n%u\n", heapsize, g->num_ids,
+		(uint32_t)g->ops, 1);
+	return;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BIN_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = BIN_BYTE_ORDER;
+    hdr.sugg_heapsize = heapsize;
+    hdr.num_ids = g->num_ids;
+    hdr.num_ops = g->ops;
+    hdr.weight = 1;
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1)
+	unix_error("Could not write the trace");
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+/*
+ * rnd - Return the next 64 random bits (xorshift64*)
+ */
+static uint64_t rnd(gen_t *g)
+{
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return g->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+ * rnd01 - Return a random number in [0, 1)
+ */
+static double rnd01(gen_t *g)
+{
+    return (rnd(g) >> 11) * 0x1p-53;
+}
+
+/*
+ * parse_dist - Parse a size distribution of the form
+ *     "power[:alpha[:min[:max]]]" or "bimodal[:small[:large[:pct]]]"
+ */
+static void parse_dist(model_t *m, char *arg)
+{
+    double pct = m->p_small * 100;
+
+    if (!strncmp(arg, "power", 5) && (arg[5] == '\0' || arg[5] == ':')) {
+	m->dist = DIST_POWER;
+	sscanf(arg + 5, ":%lf:%u:%u", &m->alpha, &m->min_size, &m->max_size);
+    } else if (!strncmp(arg, "bimodal", 7) &&
+	       (arg[7] == '\0' || arg[7] == ':')) {
+	m->dist = DIST_BIMODAL;
+	sscanf(arg + 7, ":%u:%u:%lf", &m->small, &m->large, &pct);
+	m->p_small = pct / 100;
+    } else {
+	usage();
+	exit(1);
+    }
+    if (m->alpha <= 0 || m->min_size == 0 || m->min_size > m->max_size ||
+	m->small < 2 || m->large < 2 || pct < 0 || pct > 100)
+	app_error("Bad size distribution");
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracegen [-bhP] [-d <dist>] [-l <order>] [-m <bytes>] [-n <ops>]\n");
+    fprintf(stderr, "                [-o <file>] [-r <pct>] [-s <seed>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b         Write the binary trace format.\n");
+    fprintf(stderr, "\t-d <dist>  Sizes: power[:alpha[:min[:max]]] (default power:1.5:16:16384)\n");
+    fprintf(stderr, "\t           or bimodal[:small[:large[:pct]]] (default bimodal:32:4096:90).\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-l <order> Free blocks in fifo, lifo or random (default) order.\n");
+    fprintf(stderr, "\t-m <bytes> Keep at most <bytes> live (default %d).\n", DEF_LIVE);
+    fprintf(stderr, "\t-n <ops>   Generate about <ops> requests (default %d).\n", DEF_OPS);
+    fprintf(stderr, "\t-o <file>  Write the trace to <file> instead of stdout.\n");
+    fprintf(stderr, "\t-P         Alternate filling and draining the heap.\n");
+    fprintf(stderr, "\t-r <pct>   Start a realloc growth chain at <pct>%% of allocs.\n");
+    fprintf(stderr, "\t-s <seed>  Seed the random number generator (default %d).\n", DEF_SEED);
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "tracegen: %s\n", msg);
+    perror("tracegen");
+    exit(1);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    fprintf(stderr, "tracegen: %s\n", msg);
+    exit(1);
+}